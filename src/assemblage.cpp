@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+#include "assemblage.h"
+#include "statistics.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+std::shared_ptr<TraitFrequencies> AssemblageWindow::to_trait_frequencies() {
+	return compact_trait_frequencies(trait_counts);
+}
+
+
+
+AssemblageAccumulator::AssemblageAccumulator(int numloci, int window_length, int window_step) 
+	: numloci(numloci), window_step(window_step), generation(0), block_counts(numloci) {
+	// windows are assembled from whole blocks of window_step generations
+	this->window_length = ((window_length + window_step - 1) / window_step) * window_step;
+	reserve_threads(1);
+	open_windows.push_back(std::make_shared<AssemblageWindow>(numloci, 0));
+}
+
+
+void AssemblageAccumulator::reserve_threads(int num_threads) {
+	if((int)thread_counts.size() < num_threads) {
+		thread_counts.resize(num_threads, std::vector<TraitCounter>(numloci));
+	}
+}
+
+
+void AssemblageAccumulator::end_generation() {
+	timer.start("assemblage::end_generation");
+	int num_threads = thread_counts.size();
+
+	// fold the traits present in each thread's counters into the block, clearing them for the next generation
+	#pragma omp parallel for schedule(dynamic) if(numloci > 1)
+	for(int locus = 0; locus < numloci; locus++) {
+		for(int t = 0; t < num_threads; t++) {
+			TraitCounter& tc = thread_counts[t][locus];
+			block_counts[locus].merge(tc);
+			tc.clear();
+		}
+	}
+	++generation;
+
+	if(generation % window_step == 0) {
+		for(auto it = open_windows.begin(); it != open_windows.end(); ++it) {
+			for(int locus = 0; locus < numloci; locus++) {
+				(*it)->trait_counts[locus].merge(block_counts[locus]);
+			}
+			(*it)->num_generations += window_step;
+		}
+		for(int locus = 0; locus < numloci; locus++) {
+			block_counts[locus].clear();
+		}
+
+		// windows retire in the order they were opened
+		while(!open_windows.empty() && open_windows.front()->num_generations >= window_length) {
+			completed_windows.push_back(open_windows.front());
+			open_windows.pop_front();
+		}
+		open_windows.push_back(std::make_shared<AssemblageWindow>(numloci, generation));
+	}
+	timer.end("assemblage::end_generation");
+}
+
+
+std::vector<std::shared_ptr<AssemblageWindow>> AssemblageAccumulator::take_completed_windows() {
+	std::vector<std::shared_ptr<AssemblageWindow>> completed;
+	completed.swap(completed_windows);
+	return completed;
+}
+
+
+};
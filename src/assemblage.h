@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <memory>
+#include "defines.h"
+#include "statistics.h"
+
+
+namespace CTModels {
+
+/** \class AssemblageWindow
+*
+* AssemblageWindow holds the time-averaged ("duration") assemblage for one window of generations:
+* the trait counts of every generation in the window, summed.  The sums are kept sparsely per locus,
+* 64 bits wide since a window of a large population quickly exceeds the range of an int, and only for
+* traits present at some point in the window.  
+*/
+
+class AssemblageWindow {
+public:
+	std::vector<TraitCounter> trait_counts;
+	int numloci;
+	int start_generation;
+	int num_generations;
+
+	AssemblageWindow(int n, int start) : trait_counts(n), numloci(n), start_generation(start), num_generations(0) {}
+
+	/**
+	* Copies the summed counts into a TraitFrequencies object with compact columns, so the usual statistics
+	* can be calculated on the assemblage.  Sums larger than an int can hold are clamped.  
+	*/
+	std::shared_ptr<TraitFrequencies> to_trait_frequencies();
+};
+
+
+
+/** \class AssemblageAccumulator
+*
+* Folds the trait counts of successive generations into running sums over windows of window_length
+* generations, opening a new window every window_step generations.  window_step == window_length gives 
+* back-to-back (tumbling) windows, while a smaller step gives overlapping (sliding) windows.  The window
+* length is rounded up to a multiple of the step.  
+*
+* Each OpenMP thread counts into its own sparse per-locus counters, normally from inside the transmission
+* copy loop of a Population (see Population::set_accumulator()).  end_generation() then folds the traits 
+* present in the thread counters into a block sum for the current step, and at the end of each step the
+* block is added to every open window, so each generation's counts are touched once no matter how many 
+* windows overlap.  All of this costs in proportion to the traits present, never to the number of traits
+* ever introduced.  Completed windows are queued until collected with take_completed_windows().  
+*/
+
+class AssemblageAccumulator {
+private:
+	int numloci;
+	int window_length;
+	int window_step;
+	int generation;
+	std::vector<std::vector<TraitCounter>> thread_counts;
+	std::vector<TraitCounter> block_counts;
+	std::deque<std::shared_ptr<AssemblageWindow>> open_windows;
+	std::vector<std::shared_ptr<AssemblageWindow>> completed_windows;
+
+public:
+	AssemblageAccumulator(int numloci, int window_length, int window_step);
+
+	/**
+	* Ensures there are counters for a team of num_threads threads.  Called by one thread of the team that 
+	* is about to count, before any of them does.  
+	*/
+	void reserve_threads(int num_threads);
+
+	/**
+	* Returns the per-locus counters of one OpenMP thread, indexed by locus.
+	*/
+	TraitCounter* thread_counts_for(int thread) { return thread_counts[thread].data(); }
+
+	int get_generation() { return generation; }
+
+	/**
+	* Marks the end of a generation whose counts have been placed in the thread counters:  folds them into
+	* the current block, and on block boundaries into the open windows, retiring any that are complete.
+	*/
+	void end_generation();
+
+	/**
+	* Returns the windows completed since the last call, oldest first, and clears the queue.
+	*/
+	std::vector<std::shared_ptr<AssemblageWindow>> take_completed_windows();
+};
+
+};
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+#include <math.h>
+#include <spdlog/spdlog.h>
+
+#include "association.h"
+#include "globals.h"
+#include "timer.h"
+
+namespace spd = spdlog;
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+// loci per tile, and individuals per block within a tile pair
+static const int LOCUS_TILE = 4;
+static const int INDIV_BLOCK = 4096;
+
+
+std::shared_ptr<LocusAssociations> calculate_locus_associations(std::shared_ptr<CompactedTraits> ct) {
+	timer.start("association::calculate_locus_associations");
+	std::shared_ptr<LocusAssociations> la(new LocusAssociations(ct));
+	int numloci = ct->numloci;
+	int n = ct->num_individuals;
+
+	for(int a = 0; a < numloci; a++) {
+		for(int b = a + 1; b < numloci; b++) {
+			la->tables[la->pair_index(a, b)].assign((size_t)ct->richness(a) * ct->richness(b), 0);
+		}
+	}
+
+	// enumerate tile pairs (ta <= tb); each owns the locus pairs a < b with a in ta and b in tb, so no two
+	// units of work ever write the same table
+	int num_tiles = (numloci + LOCUS_TILE - 1) / LOCUS_TILE;
+	std::vector<std::pair<int,int>> tile_pairs;
+	for(int ta = 0; ta < num_tiles; ta++) {
+		for(int tb = ta; tb < num_tiles; tb++) {
+			tile_pairs.push_back(std::make_pair(ta, tb));
+		}
+	}
+
+	#pragma omp parallel for schedule(dynamic)
+	for(int tp = 0; tp < (int)tile_pairs.size(); tp++) {
+		int a_begin = tile_pairs[tp].first * LOCUS_TILE;
+		int a_end = std::min(a_begin + LOCUS_TILE, numloci);
+		int b_begin = tile_pairs[tp].second * LOCUS_TILE;
+		int b_end = std::min(b_begin + LOCUS_TILE, numloci);
+
+		for(int block = 0; block < n; block += INDIV_BLOCK) {
+			int block_end = std::min(block + INDIV_BLOCK, n);
+			for(int a = a_begin; a < a_end; a++) {
+				const int* col_a = ct->columns[a].data();
+				for(int b = std::max(b_begin, a + 1); b < b_end; b++) {
+					const int* col_b = ct->columns[b].data();
+					int width = ct->richness(b);
+					int* table = la->tables[la->pair_index(a, b)].data();
+					for(int i = block; i < block_end; i++) {
+						++table[col_a[i] * width + col_b[i]];
+					}
+				}
+			}
+		}
+	}
+
+	// summary measures from the marginals of each table
+	#pragma omp parallel for schedule(dynamic)
+	for(int a = 0; a < numloci; a++) {
+		for(int b = a + 1; b < numloci; b++) {
+			int ka = ct->richness(a);
+			int kb = ct->richness(b);
+			const int* table = la->tables[la->pair_index(a, b)].data();
+			std::vector<double> row_sums(ka, 0.0);
+			std::vector<double> col_sums(kb, 0.0);
+			for(int i = 0; i < ka; i++) {
+				for(int j = 0; j < kb; j++) {
+					row_sums[i] += table[i * kb + j];
+					col_sums[j] += table[i * kb + j];
+				}
+			}
+
+			double chi2 = 0.0;
+			double mi = 0.0;
+			for(int i = 0; i < ka; i++) {
+				for(int j = 0; j < kb; j++) {
+					double observed = table[i * kb + j];
+					double expected = row_sums[i] * col_sums[j] / n;
+					chi2 += (observed - expected) * (observed - expected) / expected;
+					if(observed > 0) {
+						mi += (observed / n) * log(observed / expected);
+					}
+				}
+			}
+			int min_k = std::min(ka, kb);
+			double v = (min_k > 1) ? sqrt(chi2 / ((double)n * (min_k - 1))) : 0.0;
+
+			la->chi_square[a * numloci + b] = la->chi_square[b * numloci + a] = chi2;
+			la->mutual_information[a * numloci + b] = la->mutual_information[b * numloci + a] = mi;
+			la->cramers_v[a * numloci + b] = la->cramers_v[b * numloci + a] = v;
+		}
+	}
+
+	timer.end("association::calculate_locus_associations");
+	return la;
+}
+
+
+void print_locus_associations(std::shared_ptr<LocusAssociations> la) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+
+		for(int a = 0; a < la->numloci; a++) {
+			for(int b = a + 1; b < la->numloci; b++) {
+				std::stringstream s;
+				s << "association @ loci: " << a << "," << b << ": ";
+				s << "chi-square: " << std::fixed << std::setprecision(4) << la->chi_square[a * la->numloci + b];
+				s << " mutual information: " << la->mutual_information[a * la->numloci + b];
+				s << " Cramer's V: " << la->cramers_v[a * la->numloci + b];
+				SPDLOG_DEBUG(clog,"{}",s.str());
+			}
+		}
+	}
+}
+
+
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "defines.h"
+
+
+namespace CTModels {
+
+/** \class CompactedTraits
+*
+* A column-major copy of the traits of a set of individuals, in which trait IDs at each locus are 
+* renumbered densely from 0 in order of first appearance.  columns[locus][i] is the compact ID of individual
+* i's trait at the locus, and trait_ids[locus][id] recovers the original trait ID.  Compact IDs keep 
+* contingency tables between loci as small as the number of traits actually present, and contiguous columns
+* let pairwise computations stream the two loci involved.
+*/
+
+class CompactedTraits {
+public:
+	int numloci;
+	int num_individuals;
+	std::vector<std::vector<int>> columns;
+	std::vector<std::vector<int>> trait_ids;
+
+	CompactedTraits(int numloci, int n) : numloci(numloci), num_individuals(n), columns(numloci), trait_ids(numloci) {}
+
+	int richness(int locus) const { return trait_ids[locus].size(); }
+};
+
+
+/** \class LocusAssociations
+*
+* Pairwise co-occurrence of traits between loci.  For each pair of loci a < b, tables[pair_index(a, b)] is
+* the contingency table of compact trait IDs, addressed as table[id_a * richness(b) + id_b].  The summary
+* matrices are numloci x numloci and symmetric, with the diagonal left at zero:
+*
+*   - chi_square:  Pearson's chi-square statistic for independence of the two loci
+*   - mutual_information:  mutual information between the loci, in nats
+*   - cramers_v:  Cramer's V, chi-square scaled to [0, 1]
+*/
+
+class LocusAssociations {
+public:
+	int numloci;
+	int num_individuals;
+	std::shared_ptr<CompactedTraits> traits;
+	std::vector<std::vector<int>> tables;
+	std::vector<double> chi_square;
+	std::vector<double> mutual_information;
+	std::vector<double> cramers_v;
+
+	LocusAssociations(std::shared_ptr<CompactedTraits> ct) : numloci(ct->numloci), num_individuals(ct->num_individuals), traits(ct),
+		tables(ct->numloci * (ct->numloci - 1) / 2), chi_square(ct->numloci * ct->numloci, 0.0),
+		mutual_information(ct->numloci * ct->numloci, 0.0), cramers_v(ct->numloci * ct->numloci, 0.0) {}
+
+	inline int pair_index(int a, int b) const { return a * numloci - a * (a + 1) / 2 + (b - a - 1); }
+};
+
+
+/* Defined in association.cpp */
+
+/**
+* Builds co-occurrence tables and association measures for every pair of loci.  Loci are grouped into 
+* tiles, and each tile pair is a unit of parallel work which walks the individuals in cache-sized blocks, 
+* so the block of every column in the two tiles stays resident while all of their pairs are counted.
+*/
+std::shared_ptr<LocusAssociations> calculate_locus_associations(std::shared_ptr<CompactedTraits> ct);
+
+void print_locus_associations(std::shared_ptr<LocusAssociations> la);
+
+};
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <spdlog/spdlog.h>
+
+#include "batch.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+BatchOutput::BatchOutput(const std::string& path, bool append) {
+	out = fopen(path.c_str(), append ? "a" : "w");
+	if(out == NULL) {
+		clog->error("cannot open batch output file {}", path);
+		return;
+	}
+	fseek(out, 0, SEEK_END);
+	if(ftell(out) == 0) fprintf(out, "config\treplicate\tpopsize\tnumloci\tinittraits\tinnovrate\trule\tsimlength\tlocus\trichness\tentropy\tsimpson\tevenness\tdominant\telapsed\n");
+}
+
+
+BatchOutput::~BatchOutput() {
+	if(out != NULL) fclose(out);
+}
+
+
+void BatchOutput::write(const RunParameters& params, const ReplicateResult& result) {
+	std::lock_guard<std::mutex> guard(lock);
+	const TraitStatistics& ts = *result.stats;
+	for(int locus = 0; locus < ts.numloci; locus++) {
+		fprintf(out, "%d\t%d\t%d\t%d\t%d\t%g\t%s\t%d\t%d\t%d\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\n",
+			result.config_index, result.replicate, params.popsize, params.numloci, params.inittraits,
+			params.innovation_rate, (params.rule == WFIA) ? "wfia" : "basicwf", params.simlength, locus,
+			ts.trait_richness_by_locus[locus], ts.shannon_entropy_by_locus[locus], ts.simpson_diversity_by_locus[locus],
+			ts.evenness_by_locus[locus], ts.dominant_freq_by_locus[locus], result.elapsed);
+	}
+}
+
+
+void BatchOutput::flush() {
+	std::lock_guard<std::mutex> guard(lock);
+	fflush(out);
+}
+
+
+static void apply_thread_allotment(const std::atomic<int>* thread_allotment) {
+#if defined(_OPENMP)
+	if(thread_allotment) {
+		omp_set_num_threads(thread_allotment->load(std::memory_order_relaxed));
+	}
+#endif
+}
+
+
+ReplicateResult run_replicate(Population& pop, const RunParameters& params, int config_index, int replicate, 
+	const std::atomic<int>* thread_allotment) {
+	apply_thread_allotment(thread_allotment);
+	pop.reset(params.popsize, params.numloci, params.inittraits, params.innovation_rate);
+	return continue_replicate(pop, params, config_index, replicate, thread_allotment);
+}
+
+
+ReplicateResult continue_replicate(Population& pop, const RunParameters& params, int config_index, int replicate, 
+	const std::atomic<int>* thread_allotment, CheckpointWriter* checkpointer, int checkpoint_interval) {
+	auto start = std::chrono::steady_clock::now();
+	bool checkpointing = checkpointer != nullptr && checkpoint_interval > 0;
+
+	while(pop.get_generation() < params.simlength) {
+		apply_thread_allotment(thread_allotment);
+		switch(params.rule) {
+			case BASICWF :
+				pop.step_basicwf();
+				break;
+			case WFIA :
+				pop.step_wfia();
+				break;
+		}
+		if(checkpointing && pop.get_generation() % checkpoint_interval == 0 && pop.get_generation() < params.simlength) {
+			pop.write_checkpoint(*checkpointer, params.rule);
+		}
+	}
+	apply_thread_allotment(thread_allotment);
+
+	ReplicateResult result;
+	result.config_index = config_index;
+	result.replicate = replicate;
+	result.stats = calculate_trait_statistics(pop.tabulate_trait_counts());
+	result.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+
+long run_batch(const std::vector<RunParameters>& configs, int replicates, BatchOutput& output) {
+	timer.start("batch::run_batch");
+	long runs = 0;
+	if(configs.empty()) {
+		timer.end("batch::run_batch");
+		return 0;
+	}
+
+	// one population serves the whole batch; its buffers grow to the largest configuration and stay there
+	const RunParameters& first = configs[0];
+	Population pop(first.popsize, first.numloci, first.inittraits, first.innovation_rate);
+
+	for(size_t c = 0; c < configs.size(); c++) {
+		for(int rep = 0; rep < replicates; rep++) {
+			output.write(configs[c], run_replicate(pop, configs[c], c, rep));
+			++runs;
+		}
+		SPDLOG_DEBUG(clog, "batch: finished {} replicates of configuration {}", replicates, c);
+	}
+	output.flush();
+	timer.end("batch::run_batch");
+	return runs;
+}
+
+
+bool read_run_parameters(const std::string& path, std::vector<RunParameters>& configs) {
+	std::ifstream in(path.c_str());
+	if(!in) {
+		clog->error("cannot read configuration file {}", path);
+		return false;
+	}
+
+	std::string line;
+	int line_num = 0;
+	while(std::getline(in, line)) {
+		++line_num;
+		std::istringstream fields(line);
+		std::string rule;
+		RunParameters params;
+		if(!(fields >> params.popsize)) {
+			// blank or comment line
+			std::istringstream check(line);
+			std::string word;
+			if(!(check >> word) || word[0] == '#') continue;
+			clog->error("{}:{}: malformed configuration", path, line_num);
+			return false;
+		}
+		if(!(fields >> params.numloci >> params.inittraits >> params.innovation_rate >> rule >> params.simlength) 
+			|| (rule != "basicwf" && rule != "wfia") || !valid_run_parameters(params)) {
+			clog->error("{}:{}: malformed configuration", path, line_num);
+			return false;
+		}
+		params.rule = (rule == "wfia") ? WFIA : BASICWF;
+		configs.push_back(params);
+	}
+	return true;
+}
+
+
+bool valid_run_parameters(const RunParameters& params) {
+	return params.popsize > 0 && params.numloci > 0 && params.inittraits > 0;
+}
+
+
+};
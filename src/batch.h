@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdio.h>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include "defines.h"
+#include "population.h"
+#include "statistics.h"
+#include "checkpoint.h"
+
+
+namespace CTModels {
+
+/** \class RunParameters
+*
+* The parameters of one simulation configuration:  population size, loci, initial traits, innovation rate,
+* copying rule and length in generations.
+*/
+
+class RunParameters {
+public:
+	int popsize;
+	int numloci;
+	int inittraits;
+	double innovation_rate;
+	ruletype rule;
+	int simlength;
+};
+
+
+/** \class ReplicateResult
+*
+* The outcome of one replicate:  which configuration and replicate it was, its final trait statistics, 
+* and its wall clock time in seconds.
+*/
+
+class ReplicateResult {
+public:
+	int config_index;
+	int replicate;
+	double elapsed;
+	std::shared_ptr<TraitStatistics> stats;
+};
+
+
+/** \class BatchOutput
+*
+* A single tab separated results stream shared by every replicate in a batch.  Each result becomes one line
+* per locus:  configuration index, replicate, popsize, numloci, inittraits, innovation rate, rule, simulation
+* length, locus, richness, entropy, simpson, evenness, dominant frequency and elapsed seconds.  Writes are
+* serialized with a mutex, so replicates running on different threads can share the stream.  
+*/
+
+class BatchOutput {
+private:
+	FILE* out;
+	std::mutex lock;
+
+public:
+	/**
+	* Opens the results file, truncating it, or if append is set, adding to it and writing the column 
+	* header only if the file is empty.
+	*/
+	BatchOutput(const std::string& path, bool append = false);
+	~BatchOutput();
+	bool is_open() { return out != NULL; }
+	void write(const RunParameters& params, const ReplicateResult& result);
+	void flush();
+};
+
+
+/**
+* Runs one replicate of a configuration on pop, which is reset to the configuration first and so may be 
+* reused across replicates and configurations without reallocating.  If thread_allotment is given, the 
+* number of OpenMP threads used within each step is re-read from it every generation, so a scheduler can 
+* widen a running replicate as others finish.  
+*/
+ReplicateResult run_replicate(Population& pop, const RunParameters& params, int config_index, int replicate, 
+	const std::atomic<int>* thread_allotment = nullptr);
+
+/**
+* Steps pop from its current generation to params.simlength and tabulates the final statistics, as the
+* second half of run_replicate(), or to finish a replicate restored from a checkpoint.  If checkpointer is 
+* given, a checkpoint is written every checkpoint_interval generations.  
+*/
+ReplicateResult continue_replicate(Population& pop, const RunParameters& params, int config_index, int replicate, 
+	const std::atomic<int>* thread_allotment = nullptr, CheckpointWriter* checkpointer = nullptr, int checkpoint_interval = 0);
+
+/**
+* Runs replicates replicates of every configuration in turn, on a single reused Population and within one 
+* process, so that logger and argument setup, array allocation and page faulting, and OpenMP thread team 
+* start-up are paid once for the whole batch instead of once per replicate.  Returns the number of 
+* replicates run.  
+*/
+long run_batch(const std::vector<RunParameters>& configs, int replicates, BatchOutput& output);
+
+/**
+* Reads configurations from a text file, one per line:  popsize numloci inittraits innovrate rule simlength,
+* where rule is basicwf or wfia.  Blank lines and lines starting with # are skipped.  Returns false if the 
+* file cannot be read or a line is malformed or fails valid_run_parameters().  
+*/
+bool read_run_parameters(const std::string& path, std::vector<RunParameters>& configs);
+
+/**
+* True if a configuration can be simulated:  popsize, numloci and inittraits must all be positive.
+*/
+bool valid_run_parameters(const RunParameters& params);
+
+};
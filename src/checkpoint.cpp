@@ -0,0 +1,144 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <spdlog/spdlog.h>
+
+#include "checkpoint.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+void PopulationSnapshot::reserve_traits(size_t cells) {
+	if(cells <= traits_capacity) return;
+	if(traits != NULL) FREE(traits);
+	traits = (int*) ALIGNED_MALLOC(cells * sizeof(int));
+	traits_capacity = cells;
+}
+
+
+
+PopulationSnapshot& CheckpointWriter::begin_checkpoint() {
+	wait();
+	return snapshot;
+}
+
+
+void CheckpointWriter::commit() {
+	writer = std::thread(&CheckpointWriter::write_snapshot, this);
+}
+
+
+bool CheckpointWriter::wait() {
+	if(writer.joinable()) {
+		writer.join();
+	}
+	return last_write_ok;
+}
+
+
+void CheckpointWriter::write_snapshot() {
+	std::string tmp_path = path + ".tmp";
+	FILE* out = fopen(tmp_path.c_str(), "wb");
+	if(out == NULL) {
+		clog->error("cannot open checkpoint file {}", tmp_path);
+		last_write_ok = false;
+		return;
+	}
+
+	CheckpointHeader& h = snapshot.header;
+	h.magic = CHECKPOINT_MAGIC;
+	h.version = CHECKPOINT_VERSION;
+	h.reserved = 0;
+	h.rng_state_bytes = snapshot.rng_state.size();
+	size_t preamble = sizeof(CheckpointHeader) + h.numloci * sizeof(int32_t) + h.rng_state_bytes;
+	h.traits_offset = ((preamble + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT) * CHECKPOINT_ALIGNMENT;
+
+	std::vector<char> padding(h.traits_offset - preamble, 0);
+	size_t cells = (size_t)h.popsize * h.numloci;
+	bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+	ok = ok && fwrite(snapshot.next_trait.data(), sizeof(int32_t), h.numloci, out) == h.numloci;
+	ok = ok && fwrite(snapshot.rng_state.data(), 1, h.rng_state_bytes, out) == h.rng_state_bytes;
+	ok = ok && fwrite(padding.data(), 1, padding.size(), out) == padding.size();
+	ok = ok && fwrite(snapshot.traits, sizeof(int), cells, out) == cells;
+	ok = (fclose(out) == 0) && ok;
+
+	if(ok && rename(tmp_path.c_str(), path.c_str()) == 0) {
+		last_write_ok = true;
+	}
+	else {
+		clog->error("failed writing checkpoint {}", path);
+		last_write_ok = false;
+	}
+}
+
+
+
+MappedCheckpoint::~MappedCheckpoint() {
+	if(base != NULL) munmap(base, length);
+}
+
+
+std::shared_ptr<MappedCheckpoint> MappedCheckpoint::open(const std::string& path) {
+	std::shared_ptr<MappedCheckpoint> mc;
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		clog->error("cannot open checkpoint {}", path);
+		return mc;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		clog->error("cannot stat checkpoint {}", path);
+		close(fd);
+		return mc;
+	}
+	size_t length = st.st_size;
+
+	// MAP_PRIVATE gives copy-on-write pages, so the simulation can write into the mapped trait matrix
+	void* base = (length >= sizeof(CheckpointHeader)) ? mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if(base == MAP_FAILED) {
+		clog->error("cannot map checkpoint {}", path);
+		return mc;
+	}
+
+	mc.reset(new MappedCheckpoint());
+	mc->base = base;
+	mc->length = length;
+	mc->header = (const CheckpointHeader*)base;
+	const CheckpointHeader& h = *mc->header;
+	if(h.magic != CHECKPOINT_MAGIC || h.version != CHECKPOINT_VERSION) {
+		clog->error("{} is not a checkpoint file of version {}", path, CHECKPOINT_VERSION);
+		return std::shared_ptr<MappedCheckpoint>();
+	}
+
+	// next_trait and the random state must fit before the trait matrix, and the matrix within the file;
+	// each size is compared against what is left, so corrupt values cannot overflow the sums
+	size_t next_trait_bytes = (size_t)h.numloci * sizeof(int32_t);
+	bool complete = h.traits_offset <= length && sizeof(CheckpointHeader) + next_trait_bytes <= h.traits_offset
+		&& h.rng_state_bytes <= h.traits_offset - sizeof(CheckpointHeader) - next_trait_bytes;
+	size_t available_cells = complete ? (length - h.traits_offset) / sizeof(int) : 0;
+	complete = complete && h.numloci > 0 && h.popsize >= 0 && (uint64_t)h.popsize <= available_cells / h.numloci;
+	if(!complete) {
+		clog->error("{} is not a complete checkpoint file", path);
+		return std::shared_ptr<MappedCheckpoint>();
+	}
+
+	const char* p = (const char*)base + sizeof(CheckpointHeader);
+	mc->next_trait = (const int*)p;
+	p += h.numloci * sizeof(int32_t);
+	mc->rng_state.assign(p, h.rng_state_bytes);
+	mc->traits = (int*)((char*)base + h.traits_offset);
+	return mc;
+}
+
+
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <memory>
+#include "defines.h"
+
+
+namespace CTModels {
+
+/*
+* Checkpoint file layout:  a CheckpointHeader, the next_trait array (numloci int32), the serialized state
+* of the population's random number engines and innovation distribution (rng_state_bytes of text), then
+* zero padding up to traits_offset, which is a multiple of the page size, followed by the popsize x numloci
+* trait matrix in the same row-major layout as Population::population_traits.  Page aligning the matrix
+* lets a restart map it directly as the population's trait array.  
+*/
+
+const uint64_t CHECKPOINT_MAGIC = 0x314B435043504D4EULL;	// "NMPCPCK1"
+const uint32_t CHECKPOINT_VERSION = 3;
+const size_t CHECKPOINT_ALIGNMENT = 4096;
+
+struct CheckpointHeader {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t numloci;
+	int64_t popsize;
+	int32_t inittraits;
+	int32_t generation;
+	double innovation_rate;
+	uint64_t rng_state_bytes;
+	uint64_t traits_offset;
+	int32_t rule;			// the ruletype the population was stepped with
+	int32_t reserved;
+};
+
+
+/** \class PopulationSnapshot
+*
+* A copy of everything needed to resume a Population:  parameters, copying rule, generation, next_trait, the
+* random engine state and the trait matrix.  The trait buffer is kept between checkpoints and only reallocated if the 
+* population grows, so taking a snapshot is a parallel memory copy.  
+*/
+
+class PopulationSnapshot {
+public:
+	CheckpointHeader header;
+	std::vector<int> next_trait;
+	std::string rng_state;
+	int* traits;
+	size_t traits_capacity;
+
+	PopulationSnapshot() : traits(NULL), traits_capacity(0) {}
+	~PopulationSnapshot() { if(traits != NULL) FREE(traits); }
+
+	void reserve_traits(size_t cells);
+};
+
+
+/** \class CheckpointWriter
+*
+* Writes checkpoints in the background.  begin_checkpoint() hands out the snapshot buffer to fill, and 
+* commit() starts a thread which writes it to a temporary file and renames it over the checkpoint path, so 
+* a crash mid-write never leaves a damaged checkpoint behind.  The simulation keeps running while the file 
+* is written, because the thread only reads the snapshot copy; the next begin_checkpoint() waits for the 
+* previous write to finish before the buffer is reused.  
+*/
+
+class CheckpointWriter {
+private:
+	std::string path;
+	PopulationSnapshot snapshot;
+	std::thread writer;
+	bool last_write_ok;
+
+	void write_snapshot();
+
+public:
+	CheckpointWriter(const std::string& path) : path(path), last_write_ok(true) {}
+	~CheckpointWriter() { wait(); }
+
+	PopulationSnapshot& begin_checkpoint();
+	void commit();
+	bool wait();
+};
+
+
+/** \class MappedCheckpoint
+*
+* A checkpoint file mapped privately into memory.  traits points at the trait matrix inside the mapping;
+* pages are copied on write, so the file itself is never modified.  The mapping lives as long as the object.
+*/
+
+class MappedCheckpoint {
+public:
+	const CheckpointHeader* header;
+	const int* next_trait;
+	std::string rng_state;
+	int* traits;
+	void* base;
+	size_t length;
+
+	MappedCheckpoint() : header(NULL), next_trait(NULL), traits(NULL), base(NULL), length(0) {}
+	~MappedCheckpoint();
+
+	/**
+	* Maps a checkpoint file, returning an empty pointer if it cannot be read, is not a checkpoint of the 
+	* current version, or its header describes more data than the file holds.
+	*/
+	static std::shared_ptr<MappedCheckpoint> open(const std::string& path);
+};
+
+};
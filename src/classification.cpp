@@ -0,0 +1,123 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+#include "classification.h"
+#include "globals.h"
+#include "timer.h"
+
+namespace spd = spdlog;
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+// largest number of mode combinations counted with a dense array
+static const long MAX_DENSE_CLASSES = 1L << 24;
+
+
+Classification::Classification(const std::vector<std::vector<int>>& mode_tables) : numloci(mode_tables.size()), max_modes(0) {
+	// the product of the mode counts is only formed while it stays within MAX_DENSE_CLASSES, since with
+	// enough loci it overflows any integer type
+	long classes = 1;
+	bool dense = true;
+	for(int locus = 0; locus < numloci; locus++) {
+		std::vector<int> table = mode_tables[locus];
+		if(table.empty()) table.push_back(0);
+		table.push_back(table.back());
+
+		int modes = *std::max_element(table.begin(), table.end()) + 1;
+		modes_per_locus.push_back(modes);
+		max_modes = std::max(max_modes, modes);
+		tables.push_back(table);
+		if(dense && classes > MAX_DENSE_CLASSES / modes) dense = false;
+		if(dense) classes *= modes;
+	}
+
+	if(!dense) {
+		clog->error("classification has more than {} mode combinations, too many to count; only modes will be tabulated", MAX_DENSE_CLASSES);
+		classes = 0;
+	}
+	num_classes = classes;
+
+	// mixed radix place values, with the last locus varying fastest; every place value is at most 
+	// num_classes, so they are only computed when classes are counted
+	radix.assign(numloci, 0);
+	if(num_classes > 0) {
+		int place = 1;
+		for(int locus = numloci - 1; locus >= 0; locus--) {
+			radix[locus] = place;
+			place *= modes_per_locus[locus];
+		}
+	}
+}
+
+
+std::shared_ptr<Classification> Classification::from_file(const std::string& path, int numloci) {
+	std::ifstream in(path.c_str());
+	if(!in) {
+		clog->error("cannot read classification file {}", path);
+		return std::shared_ptr<Classification>();
+	}
+
+	std::vector<std::vector<int>> mode_tables;
+	std::string line;
+	int line_num = 0;
+	while(std::getline(in, line)) {
+		++line_num;
+		std::istringstream fields(line);
+		std::vector<int> table;
+		int mode;
+		while(fields >> mode) {
+			if(mode < 0) {
+				clog->error("{}:{}: modes must not be negative", path, line_num);
+				return std::shared_ptr<Classification>();
+			}
+			table.push_back(mode);
+		}
+		if(!table.empty()) mode_tables.push_back(table);
+	}
+
+	if((int)mode_tables.size() != numloci) {
+		clog->error("classification file {} describes {} loci, population has {}", path, mode_tables.size(), numloci);
+		return std::shared_ptr<Classification>();
+	}
+	return std::make_shared<Classification>(mode_tables);
+}
+
+
+void print_class_frequencies(std::shared_ptr<ClassFrequencies> cf) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+
+		for(int locus = 0; locus < cf->numloci; locus++) {
+			std::stringstream s;
+			s << "modes @ locus: " << locus << ":";
+			for(int mode = 0; mode < cf->max_modes; mode++) {
+				s << " " << cf->mode_counts[locus * cf->max_modes + mode];
+			}
+			SPDLOG_DEBUG(clog,"{}",s.str());
+		}
+
+		int occupied = 0;
+		for(int c = 0; c < cf->num_classes; c++) {
+			occupied += (cf->class_counts[c] > 0);
+		}
+		SPDLOG_DEBUG(clog, "classes occupied: {} of {}", occupied, cf->num_classes);
+
+		if(clog->level() == spd::level::trace) {
+			for(int c = 0; c < cf->num_classes; c++) {
+				if(cf->class_counts[c] > 0) {
+					SPDLOG_TRACE(clog, "class {}: {}", c, cf->class_counts[c]);
+				}
+			}
+		}
+	}
+}
+
+
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "defines.h"
+
+
+namespace CTModels {
+
+/** \class Classification
+*
+* A paradigmatic classification:  at each locus, a lookup table assigns every trait ID to one of that
+* locus' modes, and a class is a combination of one mode per locus.  Traits past the end of a locus' table 
+* fall into the mode of its last entry, so tables only need to describe traits up to the last boundary, 
+* and innovations introduced later still classify.  Classes are numbered in mixed radix, with locus 0 
+* varying slowest.  
+*
+* Each table is stored with one extra trailing entry holding that final mode, so classifying a trait is a
+* single branch-free gather at min(trait, table length).  
+*/
+
+class Classification {
+public:
+	int numloci;
+	int num_classes;
+	int max_modes;
+	std::vector<int> modes_per_locus;
+	std::vector<int> radix;
+	std::vector<std::vector<int>> tables;
+
+	/**
+	* Builds a classification from per-locus tables of modes, where tables[locus][trait] is the mode of 
+	* the trait at that locus, and modes at each locus are numbered from 0.  
+	*/
+	Classification(const std::vector<std::vector<int>>& mode_tables);
+
+	/**
+	* Reads a classification from a text file with one line per locus, each a whitespace separated list
+	* of the modes of traits 0, 1, 2, ... at that locus.  Returns an empty pointer if the file cannot be
+	* read or describes a different number of loci.  
+	*/
+	static std::shared_ptr<Classification> from_file(const std::string& path, int numloci);
+
+	inline int mode(int locus, int trait) const {
+		const std::vector<int>& table = tables[locus];
+		int last = table.size() - 1;
+		return table[(trait < last) ? trait : last];
+	}
+};
+
+
+/** \class ClassFrequencies
+*
+* Counts produced by applying a Classification to a population.  mode_counts is addressed as 
+* mode_counts[locus * max_modes + mode], and class_counts[class] counts individuals in each combination
+* of modes.  class_counts is empty when the classification has more classes than can be counted densely.
+*/
+
+class ClassFrequencies {
+public:
+	int* mode_counts;
+	int* class_counts;
+	int numloci;
+	int max_modes;
+	int num_classes;
+
+	ClassFrequencies(int n, int m, int c) : numloci(n), max_modes(m), num_classes(c) {
+		size_t mode_bufsize = ((size_t)numloci * max_modes) * sizeof(int);
+		size_t class_bufsize = (size_t)num_classes * sizeof(int);
+		mode_counts = (int*) ALIGNED_MALLOC(mode_bufsize);
+		class_counts = (int*) ALIGNED_MALLOC(class_bufsize);
+		memset(mode_counts, 0, mode_bufsize);
+		memset(class_counts, 0, class_bufsize);
+	}
+
+	~ClassFrequencies() {
+		FREE(mode_counts);
+		FREE(class_counts);
+	}
+};
+
+
+/* Defined in classification.cpp */
+void print_class_frequencies(std::shared_ptr<ClassFrequencies> cf);
+
+};
@@ -0,0 +1,217 @@
+#include <iostream>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "columnar.h"
+#include "sampler.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+static_assert(sizeof(ColumnarRunHeader) == 64, "columnar run header must be 64 bytes");
+static_assert(sizeof(ColumnarChunkHeader) == 32, "columnar chunk header must be 32 bytes");
+
+static inline size_t pad8(size_t bytes) { return (bytes + 7) & ~(size_t)7; }
+
+
+static void write_column(FILE* out, const void* data, size_t bytes) {
+	static const char zeros[8] = {0};
+	if(bytes > 0) fwrite(data, 1, bytes, out);
+	fwrite(zeros, 1, pad8(bytes) - bytes, out);
+}
+
+
+
+ColumnarSampleSink::ColumnarSampleSink(const std::string& path, const ColumnarRunHeader& header, int chunk_samples)
+	: numloci(header.numloci), chunk_samples(chunk_samples), buffered(0), has_counts(false) {
+	out = fopen(path.c_str(), "wb");
+	if(out == NULL) {
+		clog->error("cannot open columnar output {}", path);
+		return;
+	}
+	ColumnarRunHeader h = header;
+	h.magic = COLUMNAR_MAGIC;
+	h.version = 1;
+	fwrite(&h, sizeof(h), 1, out);
+
+	generations.reserve(chunk_samples);
+	richness.reserve((size_t)chunk_samples * numloci);
+	entropy.reserve((size_t)chunk_samples * numloci);
+	simpson.reserve((size_t)chunk_samples * numloci);
+	evenness.reserve((size_t)chunk_samples * numloci);
+	dominant_freq.reserve((size_t)chunk_samples * numloci);
+	count_offsets.reserve((size_t)chunk_samples * numloci + 1);
+	count_offsets.push_back(0);
+}
+
+
+ColumnarSampleSink::~ColumnarSampleSink() {
+	if(out != NULL) {
+		flush();
+		fclose(out);
+	}
+}
+
+
+void ColumnarSampleSink::write(const SampleRecord& record) {
+	if(out == NULL) return;
+
+	generations.push_back(record.generation);
+	richness.insert(richness.end(), record.richness.begin(), record.richness.end());
+	entropy.insert(entropy.end(), record.entropy.begin(), record.entropy.end());
+	simpson.insert(simpson.end(), record.simpson.begin(), record.simpson.end());
+	evenness.insert(evenness.end(), record.evenness.begin(), record.evenness.end());
+	dominant_freq.insert(dominant_freq.end(), record.dominant_freq.begin(), record.dominant_freq.end());
+	has_counts = has_counts || record.has_counts;
+	for(int locus = 0; locus < numloci; locus++) {
+		if(record.has_counts) {
+			const int* row = record.trait_counts.data() + (size_t)locus * record.max_num_traits;
+			for(int column = 0; column < record.max_num_traits; column++) {
+				if(row[column] > 0) {
+					count_traits.push_back(record.trait_id(locus, column));
+					count_values.push_back(row[column]);
+				}
+			}
+		}
+		count_offsets.push_back(count_traits.size());
+	}
+
+	if(++buffered == chunk_samples) {
+		write_chunk();
+	}
+}
+
+
+void ColumnarSampleSink::write_chunk() {
+	if(buffered == 0) return;
+
+	size_t cells = (size_t)buffered * numloci;
+	size_t nnz = has_counts ? count_traits.size() : 0;
+	ColumnarChunkHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = COLUMNAR_CHUNK_MAGIC;
+	h.num_samples = buffered;
+	h.numloci = numloci;
+	h.num_counts = nnz;
+	h.payload_bytes = pad8(buffered * sizeof(int32_t)) + pad8(cells * sizeof(int32_t)) + 4 * cells * sizeof(double);
+	if(has_counts) {
+		h.payload_bytes += (cells + 1) * sizeof(uint64_t) + 2 * pad8(nnz * sizeof(int32_t));
+	}
+	fwrite(&h, sizeof(h), 1, out);
+
+	write_column(out, generations.data(), buffered * sizeof(int32_t));
+	write_column(out, richness.data(), cells * sizeof(int32_t));
+	write_column(out, entropy.data(), cells * sizeof(double));
+	write_column(out, simpson.data(), cells * sizeof(double));
+	write_column(out, evenness.data(), cells * sizeof(double));
+	write_column(out, dominant_freq.data(), cells * sizeof(double));
+	if(has_counts) {
+		write_column(out, count_offsets.data(), (cells + 1) * sizeof(uint64_t));
+		write_column(out, count_traits.data(), nnz * sizeof(int32_t));
+		write_column(out, count_values.data(), nnz * sizeof(int32_t));
+	}
+
+	generations.clear();
+	richness.clear();
+	entropy.clear();
+	simpson.clear();
+	evenness.clear();
+	dominant_freq.clear();
+	count_offsets.assign(1, 0);
+	count_traits.clear();
+	count_values.clear();
+	buffered = 0;
+	has_counts = false;
+}
+
+
+void ColumnarSampleSink::flush() {
+	if(out == NULL) return;
+	write_chunk();
+	fflush(out);
+}
+
+
+
+ColumnarReader::ColumnarReader(const std::string& path) : fd(-1), length(0), base(NULL) {
+	fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		clog->error("cannot open columnar file {}", path);
+		return;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		clog->error("cannot stat columnar file {}", path);
+		return;
+	}
+	length = st.st_size;
+	if(length < sizeof(ColumnarRunHeader)) {
+		clog->error("columnar file {} is too short", path);
+		return;
+	}
+
+	void* mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if(mapping == MAP_FAILED) {
+		clog->error("cannot map columnar file {}", path);
+		return;
+	}
+	base = (const char*)mapping;
+	if(header().magic != COLUMNAR_MAGIC) {
+		clog->error("{} is not a columnar output file", path);
+		munmap(mapping, length);
+		base = NULL;
+		return;
+	}
+
+	size_t offset = sizeof(ColumnarRunHeader);
+	while(offset + sizeof(ColumnarChunkHeader) <= length) {
+		const ColumnarChunkHeader* h = (const ColumnarChunkHeader*)(base + offset);
+		if(h->magic != COLUMNAR_CHUNK_MAGIC || offset + sizeof(ColumnarChunkHeader) + h->payload_bytes > length) break;
+
+		size_t cells = (size_t)h->num_samples * h->numloci;
+		const char* p = base + offset + sizeof(ColumnarChunkHeader);
+		ColumnarChunk c;
+		c.header = h;
+		c.generation = (const int32_t*)p;			p += pad8(h->num_samples * sizeof(int32_t));
+		c.richness = (const int32_t*)p;				p += pad8(cells * sizeof(int32_t));
+		c.entropy = (const double*)p;				p += cells * sizeof(double);
+		c.simpson = (const double*)p;				p += cells * sizeof(double);
+		c.evenness = (const double*)p;				p += cells * sizeof(double);
+		c.dominant_freq = (const double*)p;			p += cells * sizeof(double);
+		bool has_counts = h->payload_bytes > (size_t)(p - (base + offset + sizeof(ColumnarChunkHeader)));
+		c.count_offsets = has_counts ? (const uint64_t*)p : NULL;	p += has_counts ? (cells + 1) * sizeof(uint64_t) : 0;
+		c.count_traits = has_counts ? (const int32_t*)p : NULL;		p += pad8(h->num_counts * sizeof(int32_t));
+		c.count_values = has_counts ? (const int32_t*)p : NULL;
+		chunks.push_back(c);
+
+		offset += sizeof(ColumnarChunkHeader) + h->payload_bytes;
+	}
+}
+
+
+ColumnarReader::~ColumnarReader() {
+	if(base != NULL) munmap((void*)base, length);
+	if(fd >= 0) close(fd);
+}
+
+
+long ColumnarReader::num_samples() {
+	long total = 0;
+	for(auto it = chunks.begin(); it != chunks.end(); ++it) {
+		total += it->header->num_samples;
+	}
+	return total;
+}
+
+
+};
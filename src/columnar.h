@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "defines.h"
+#include "sampler.h"
+
+
+namespace CTModels {
+
+/*
+* Columnar run output.  A file is a fixed 64 byte ColumnarRunHeader describing the run, followed by 
+* any number of chunks, each a 32 byte ColumnarChunkHeader and then the chunk's columns back to back:
+*
+*   generation     int32   [num_samples]
+*   richness       int32   [num_samples * numloci]
+*   entropy        double  [num_samples * numloci]
+*   simpson        double  [num_samples * numloci]
+*   evenness       double  [num_samples * numloci]
+*   dominant_freq  double  [num_samples * numloci]
+*   count_offsets  uint64  [num_samples * numloci + 1]       (only if num_counts > 0)
+*   count_traits   int32   [num_counts]
+*   count_values   int32   [num_counts]
+*
+* Per-locus columns are sample major, addressed as column[sample * numloci + locus].  Trait counts are 
+* stored sparsely, since in infinite alleles runs nearly every trait ever seen has a zero count:  the nonzero 
+* counts of locus l in sample s are count_traits[i] and count_values[i] for i in 
+* [count_offsets[s * numloci + l], count_offsets[s * numloci + l + 1]).  Every column starts on an 8 byte 
+* boundary, so a memory mapped file can be read in place.  Chunks are only ever appended, and a reader 
+* ignores a trailing chunk whose payload is incomplete.  
+*/
+
+const uint64_t COLUMNAR_MAGIC = 0x314C4F4350434D4EULL;	// "NMCPCOL1"
+const uint32_t COLUMNAR_CHUNK_MAGIC = 0x4B4E4843;			// "CHNK"
+
+struct ColumnarRunHeader {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t numloci;
+	int64_t popsize;
+	uint32_t inittraits;
+	uint32_t ruletype;
+	double innovation_rate;
+	uint32_t sample_interval;
+	uint32_t reserved[5];
+};
+
+struct ColumnarChunkHeader {
+	uint32_t magic;
+	uint32_t num_samples;
+	uint32_t numloci;
+	uint32_t reserved;
+	uint64_t num_counts;
+	uint64_t payload_bytes;
+};
+
+
+/** \class ColumnarSampleSink
+*
+* SampleSink which writes the columnar binary format.  Samples are transposed into column buffers as they
+* arrive and written as one chunk every chunk_samples samples, and on flush(), so the file is written with 
+* a few large sequential writes.  The column buffers are reused from chunk to chunk.
+*/
+
+class ColumnarSampleSink : public SampleSink {
+private:
+	FILE* out;
+	int numloci;
+	int chunk_samples;
+	int buffered;
+	bool has_counts;
+	std::vector<int32_t> generations;
+	std::vector<int32_t> richness;
+	std::vector<double> entropy;
+	std::vector<double> simpson;
+	std::vector<double> evenness;
+	std::vector<double> dominant_freq;
+	std::vector<uint64_t> count_offsets;
+	std::vector<int32_t> count_traits;
+	std::vector<int32_t> count_values;
+
+	void write_chunk();
+
+public:
+	ColumnarSampleSink(const std::string& path, const ColumnarRunHeader& header, int chunk_samples);
+	~ColumnarSampleSink();
+	bool is_open() { return out != NULL; }
+	void write(const SampleRecord& record);
+	void flush();
+};
+
+
+/** \class ColumnarChunk
+*
+* A view of one chunk of a memory mapped columnar file.  All pointers point into the mapping.
+*/
+
+struct ColumnarChunk {
+	const ColumnarChunkHeader* header;
+	const int32_t* generation;
+	const int32_t* richness;
+	const double* entropy;
+	const double* simpson;
+	const double* evenness;
+	const double* dominant_freq;
+	const uint64_t* count_offsets;
+	const int32_t* count_traits;
+	const int32_t* count_values;
+};
+
+
+/** \class ColumnarReader
+*
+* Zero copy reader for the columnar format.  The file is memory mapped read only and its chunks indexed
+* on open; columns are then read directly from the mapping.  A chunk cut short by an interrupted write
+* ends the index.
+*/
+
+class ColumnarReader {
+private:
+	int fd;
+	size_t length;
+	const char* base;
+	std::vector<ColumnarChunk> chunks;
+
+public:
+	ColumnarReader(const std::string& path);
+	~ColumnarReader();
+
+	bool is_open() { return base != NULL; }
+	const ColumnarRunHeader& header() { return *(const ColumnarRunHeader*)base; }
+	int num_chunks() { return chunks.size(); }
+	const ColumnarChunk& chunk(int i) { return chunks[i]; }
+	long num_samples();
+};
+
+};
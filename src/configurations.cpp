@@ -0,0 +1,69 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <math.h>
+#include <spdlog/spdlog.h>
+
+#include "configurations.h"
+#include "globals.h"
+#include "timer.h"
+
+namespace spd = spdlog;
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+	#pragma omp simd
+	for(size_t i = 0; i < registers.size(); i++) {
+		registers[i] = (other.registers[i] > registers[i]) ? other.registers[i] : registers[i];
+	}
+}
+
+
+double HyperLogLog::estimate() const {
+	double m = registers.size();
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double sum = 0.0;
+	int zeros = 0;
+	for(size_t i = 0; i < registers.size(); i++) {
+		sum += ldexp(1.0, -registers[i]);
+		zeros += (registers[i] == 0);
+	}
+	double raw = alpha * m * m / sum;
+
+	// small range correction:  linear counting on the empty registers
+	if(raw <= 2.5 * m && zeros > 0) {
+		return m * log(m / zeros);
+	}
+	return raw;
+}
+
+
+void print_configuration_frequencies(std::shared_ptr<ConfigurationFrequencies> cf, int popsize) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+		SPDLOG_DEBUG(clog, "distinct configurations: {}", cf->num_configurations);
+
+		if(clog->level() == spd::level::trace) {
+			for(int c = 0; c < cf->num_configurations; c++) {
+				std::stringstream s;
+				s << "configuration " << c << ": [";
+				for(int locus = 0; locus < cf->numloci; locus++) {
+					s << (locus > 0 ? " " : "") << cf->configurations[(size_t)c * cf->numloci + locus];
+				}
+				s << "] count: " << cf->counts[c];
+				s << " freq: " << std::fixed << std::setprecision(6) << (double)cf->counts[c] / popsize;
+				SPDLOG_TRACE(clog,"{}",s.str());
+			}
+		}
+	}
+}
+
+
+};
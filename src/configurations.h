@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include "defines.h"
+
+
+namespace CTModels {
+
+/** \class ConfigurationFrequencies
+*
+* ConfigurationFrequencies holds the distinct multi-locus trait combinations ("classes") found in a 
+* population, with the number of individuals carrying each.  Configurations are stored as a rectangular 
+* array with one row of numloci traits per configuration, addressed as 
+* configurations[config * numloci + locus], and are ordered from most to least common.  
+*/
+
+class ConfigurationFrequencies {
+public:
+	int* configurations;
+	int* counts;
+	int numloci;
+	int num_configurations;
+
+	ConfigurationFrequencies(int n, int c) : numloci(n), num_configurations(c) {
+		configurations = (int*) ALIGNED_MALLOC(((size_t)num_configurations * numloci) * sizeof(int));
+		counts = (int*) ALIGNED_MALLOC(num_configurations * sizeof(int));
+	}
+
+	~ConfigurationFrequencies() {
+		FREE(configurations);
+		FREE(counts);
+	}
+};
+
+
+/** \class HyperLogLog
+*
+* HyperLogLog cardinality sketch (Flajolet et al. 2007) over 64-bit hashes, with 2^precision one-byte
+* registers and the usual linear counting correction for small cardinalities.  Relative error is about 
+* 1.04 / sqrt(2^precision).  Sketches over disjoint inputs are combined with merge().
+*/
+
+class HyperLogLog {
+private:
+	int precision;
+	std::vector<uint8_t> registers;
+
+public:
+	HyperLogLog(int precision) : precision(precision), registers((size_t)1 << precision, 0) {}
+
+	void add(uint64_t hash) {
+		uint64_t index = hash >> (64 - precision);
+		// a sentinel bit below the shifted-out index bits bounds the rank at 64 - precision + 1
+		uint64_t rest = (hash << precision) | ((uint64_t)1 << (precision - 1));
+		uint8_t rank = CLZ64(rest) + 1;
+		if(rank > registers[index]) registers[index] = rank;
+	}
+
+	void merge(const HyperLogLog& other);
+	double estimate() const;
+};
+
+
+/**
+* Hashes a row of numloci traits to 64 bits.  Written as a fixed sequence of multiply-xorshift rounds with no
+* data dependent branches, so that loops over many rows vectorize across individuals.
+*/
+inline uint64_t hash_configuration(const int* row, int numloci) {
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ (uint64_t)numloci;
+	for(int locus = 0; locus < numloci; locus++) {
+		h ^= (uint64_t)(uint32_t)row[locus];
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 32;
+	}
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+
+void print_configuration_frequencies(std::shared_ptr<ConfigurationFrequencies> cf, int popsize);
+
+};
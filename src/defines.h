@@ -12,3 +12,20 @@
 		#define ALIGNED_MALLOC(x) malloc(x)
 #endif
 
+
+// Bit scanning on 64-bit occupancy words; both gcc/clang and icc provide these builtins
+#define POPCOUNT64(x) __builtin_popcountll(x)
+#define CTZ64(x) __builtin_ctzll(x)
+#define CLZ64(x) __builtin_clzll(x)
+
+// OpenMP thread queries, which collapse to a single thread when built without OpenMP
+#if defined(_OPENMP)
+	#include <omp.h>
+	#define THREAD_NUM() omp_get_thread_num()
+	#define MAX_THREADS() omp_get_max_threads()
+	#define NUM_THREADS() omp_get_num_threads()
+#else
+	#define THREAD_NUM() 0
+	#define MAX_THREADS() 1
+	#define NUM_THREADS() 1
+#endif
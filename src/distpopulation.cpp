@@ -0,0 +1,295 @@
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <map>
+#include <unordered_map>
+#include <string.h>
+#include <spdlog/spdlog.h>
+
+#include "distpopulation.h"
+#include "parallel_random.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+// number of trait IDs a rank takes at a time for its innovations at one locus
+static const int TRAIT_ID_BLOCK = 4096;
+
+// generate_uniform_int() counts variates in an int, so very large blocks of a rank are filled in pieces
+static const size_t MAX_VARIATES_PER_CALL = 1 << 30;
+
+// individuals whose parents are fetched in one round of the exchange, which bounds its buffers
+static const int EXCHANGE_ROUND_ROWS = 1 << 20;
+
+
+DistributedPopulation::DistributedPopulation(int p, int n, int i, double r) 
+	: popsize(p), numloci(n), inittraits(i), innovation_rate(r), rank(0), nranks(1) {
+#if defined(USE_MPI)
+	comm = MPI_COMM_WORLD;
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &nranks);
+	MPI_Type_contiguous(numloci, MPI_INT, &row_type);
+	MPI_Type_commit(&row_type);
+#endif
+
+	// block distribution, the first popsize % nranks ranks holding one extra individual
+	int base = popsize / nranks;
+	int extra = popsize % nranks;
+	rank_offsets.resize(nranks + 1);
+	for(int r = 0; r <= nranks; r++) {
+		rank_offsets[r] = r * base + std::min(r, extra);
+	}
+	local_offset = rank_offsets[rank];
+	local_size = rank_offsets[rank + 1] - local_offset;
+}
+
+
+DistributedPopulation::~DistributedPopulation() {
+	FREE(population_traits);
+	FREE(prev_population_traits);
+	FREE(parents);
+#if defined(USE_MPI)
+	MPI_Type_free(&row_type);
+#endif
+}
+
+
+int DistributedPopulation::owner_of(int global_indiv) {
+	int base = popsize / nranks;
+	int extra = popsize % nranks;
+	int big = extra * (base + 1);
+	return (global_indiv < big) ? global_indiv / (base + 1) : extra + (global_indiv - big) / base;
+}
+
+
+void DistributedPopulation::initialize() {
+	timer.start("distpopulation::initialize");
+	if(seeded) {
+		std::seed_seq seq{(uint32_t)seed_value, (uint32_t)(seed_value >> 32), (uint32_t)rank};
+		mt.seed(seq);
+	}
+	else {
+		std::random_device rd;
+		mt.seed(rd());
+	}
+
+	std::poisson_distribution<int> p{static_cast<double>(local_size) * innovation_rate};
+	poisson_dist = p;
+	std::uniform_int_distribution<int> u{0, std::max(0, local_size - 1)};
+	uniform_local = u;
+	std::uniform_int_distribution<int> l{0, numloci - 1};
+	uniform_locus = l;
+
+	next_trait.assign(numloci, 0);
+	block_end.assign(numloci, 0);
+	blocks_taken.assign(numloci, 0);
+
+	size_t cells = (size_t)local_size * numloci;
+	population_traits = (int*) ALIGNED_MALLOC(cells * sizeof(int));
+	prev_population_traits = (int*) ALIGNED_MALLOC(cells * sizeof(int));
+	parents = (int*) ALIGNED_MALLOC(std::max(1, std::min(local_size, EXCHANGE_ROUND_ROWS)) * sizeof(int));
+
+	for(size_t first = 0; first < cells; first += MAX_VARIATES_PER_CALL) {
+		int num_variates = std::min(MAX_VARIATES_PER_CALL, cells - first);
+		generate_uniform_int(0, inittraits - 1, num_variates, population_traits + first, mt());
+	}
+	timer.end("distpopulation::initialize");
+}
+
+
+int DistributedPopulation::new_trait(int locus) {
+	if(next_trait[locus] == block_end[locus]) {
+		int block = blocks_taken[locus]++ * nranks + rank;
+		next_trait[locus] = inittraits + 1 + block * TRAIT_ID_BLOCK;
+		block_end[locus] = next_trait[locus] + TRAIT_ID_BLOCK;
+	}
+	return next_trait[locus]++;
+}
+
+
+void DistributedPopulation::fetch_parent_rows() {
+	timer.start("distpopulation::fetch_parent_rows");
+
+	// Rounds are collective, so every rank runs as many as the largest block needs (the first rank's),
+	// taking part with no requests of its own once its individuals are done.
+	int max_local = rank_offsets[1] - rank_offsets[0];
+	int rounds = (max_local + EXCHANGE_ROUND_ROWS - 1) / EXCHANGE_ROUND_ROWS;
+	for(int round = 0; round < rounds; round++) {
+		int first = std::min(local_size, round * EXCHANGE_ROUND_ROWS);
+		int count = std::min(local_size - first, EXCHANGE_ROUND_ROWS);
+		fetch_parent_rows_round(first, count);
+	}
+	timer.end("distpopulation::fetch_parent_rows");
+}
+
+
+void DistributedPopulation::fetch_parent_rows_round(int first, int count) {
+	generate_uniform_int(0, popsize, count, parents, mt());
+
+	// group the requests by owning rank with a counting sort, translating each parent to its row on the owner
+	send_counts.assign(nranks, 0);
+	for(int i = 0; i < count; i++) {
+		++send_counts[owner_of(parents[i])];
+	}
+	send_displs.assign(nranks, 0);
+	for(int r = 1; r < nranks; r++) {
+		send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+	}
+	std::vector<int> pos(send_displs);
+	request_order.resize(count);
+	outgoing_requests.resize(count);
+	for(int i = 0; i < count; i++) {
+		int owner = owner_of(parents[i]);
+		int k = pos[owner]++;
+		request_order[k] = first + i;
+		outgoing_requests[k] = parents[i] - rank_offsets[owner];
+	}
+
+#if defined(USE_MPI)
+	recv_counts.resize(nranks);
+	MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+	recv_displs.assign(nranks, 0);
+	for(int r = 1; r < nranks; r++) {
+		recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+	}
+	int num_incoming = recv_displs[nranks - 1] + recv_counts[nranks - 1];
+	incoming_requests.resize(num_incoming);
+	MPI_Alltoallv(outgoing_requests.data(), send_counts.data(), send_displs.data(), MPI_INT,
+		incoming_requests.data(), recv_counts.data(), recv_displs.data(), MPI_INT, comm);
+#else
+	incoming_requests = outgoing_requests;
+	int num_incoming = count;
+#endif
+
+	// serve the rows other ranks asked for from our previous generation
+	served_rows.resize((size_t)num_incoming * numloci);
+	int* served = served_rows.data();
+	const int* requests = incoming_requests.data();
+	#pragma omp parallel for schedule(static)
+	for(int k = 0; k < num_incoming; k++) {
+		for(int locus = 0; locus < numloci; locus++) {
+			served[(size_t)k * numloci + locus] = prev_population_traits[(size_t)requests[k] * numloci + locus];
+		}
+	}
+
+#if defined(USE_MPI)
+	fetched_rows.resize((size_t)count * numloci);
+	MPI_Alltoallv(served_rows.data(), recv_counts.data(), recv_displs.data(), row_type,
+		fetched_rows.data(), send_counts.data(), send_displs.data(), row_type, comm);
+#else
+	fetched_rows.swap(served_rows);
+#endif
+
+	// and put the rows we received back in the order of our individuals
+	const int* fetched = fetched_rows.data();
+	const int* order = request_order.data();
+	#pragma omp parallel for schedule(static)
+	for(int k = 0; k < count; k++) {
+		for(int locus = 0; locus < numloci; locus++) {
+			population_traits[(size_t)order[k] * numloci + locus] = fetched[(size_t)k * numloci + locus];
+		}
+	}
+}
+
+
+void DistributedPopulation::step_basicwf() {
+	std::swap(population_traits, prev_population_traits);
+	++generation;
+	fetch_parent_rows();
+}
+
+
+void DistributedPopulation::step_wfia() {
+	std::swap(population_traits, prev_population_traits);
+	++generation;
+	fetch_parent_rows();
+
+	if(local_size == 0) return;
+	int num_mutations = poisson_dist(mt);
+	for(int j = 0; j < num_mutations; j++) {
+		int indiv_to_mutate = uniform_local(mt);
+		int locus_to_mutate = uniform_locus(mt);
+		population_traits[(size_t)indiv_to_mutate * numloci + locus_to_mutate] = new_trait(locus_to_mutate);
+	}
+}
+
+
+std::shared_ptr<TraitFrequencies> DistributedPopulation::tabulate_trait_counts() {
+	timer.start("distpopulation::tabulate_trait_counts");
+
+	// Trait IDs are spread over interleaved per-rank blocks, so a dense count array would be as wide as
+	// nranks * TRAIT_ID_BLOCK however few traits exist.  Each locus is counted sparsely by one thread over
+	// this rank's rows, and only the (locus, trait, count) triples of traits present travel to rank 0.
+	std::vector<std::vector<int>> locus_triples(numloci);
+	#pragma omp parallel for schedule(dynamic)
+	for(int locus = 0; locus < numloci; locus++) {
+		std::unordered_map<int, int> counts;
+		for(int indiv = 0; indiv < local_size; indiv++) {
+			++counts[population_traits[(size_t)indiv * numloci + locus]];
+		}
+		std::vector<int>& triples = locus_triples[locus];
+		triples.reserve(3 * counts.size());
+		for(auto it = counts.begin(); it != counts.end(); ++it) {
+			triples.push_back(locus);
+			triples.push_back(it->first);
+			triples.push_back(it->second);
+		}
+	}
+	std::vector<int> local_triples;
+	for(int locus = 0; locus < numloci; locus++) {
+		local_triples.insert(local_triples.end(), locus_triples[locus].begin(), locus_triples[locus].end());
+	}
+
+	std::vector<int> all_triples;
+#if defined(USE_MPI)
+	int num_local = local_triples.size();
+	std::vector<int> triple_counts(nranks);
+	std::vector<int> triple_displs(nranks, 0);
+	MPI_Gather(&num_local, 1, MPI_INT, triple_counts.data(), 1, MPI_INT, 0, comm);
+	if(rank == 0) {
+		for(int r = 1; r < nranks; r++) {
+			triple_displs[r] = triple_displs[r - 1] + triple_counts[r - 1];
+		}
+		all_triples.resize(triple_displs[nranks - 1] + triple_counts[nranks - 1]);
+	}
+	MPI_Gatherv(local_triples.data(), num_local, MPI_INT, all_triples.data(), triple_counts.data(), triple_displs.data(), MPI_INT, 0, comm);
+#else
+	all_triples.swap(local_triples);
+#endif
+
+	std::shared_ptr<TraitFrequencies> tf;
+	if(rank != 0) {
+		timer.end("distpopulation::tabulate_trait_counts");
+		return tf;
+	}
+
+	// merge on rank 0 into compact columns, in increasing trait order at each locus
+	std::vector<std::map<int, int>> merged(numloci);
+	for(size_t i = 0; i < all_triples.size(); i += 3) {
+		merged[all_triples[i]][all_triples[i + 1]] += all_triples[i + 2];
+	}
+	int width = 1;
+	for(int locus = 0; locus < numloci; locus++) {
+		width = std::max(width, (int)merged[locus].size());
+	}
+	tf.reset(new TraitFrequencies(numloci, width));
+	tf->trait_ids.assign((size_t)numloci * width, -1);
+	for(int locus = 0; locus < numloci; locus++) {
+		int column = 0;
+		for(auto it = merged[locus].begin(); it != merged[locus].end(); ++it, ++column) {
+			tf->trait_counts[(size_t)locus * width + column] = it->second;
+			tf->trait_ids[(size_t)locus * width + column] = it->first;
+		}
+	}
+	tf->build_occupancy();
+	timer.end("distpopulation::tabulate_trait_counts");
+	return tf;
+}
+
+
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "defines.h"
+#include "statistics.h"
+
+#if defined(USE_MPI)
+#include <mpi.h>
+#endif
+
+
+namespace CTModels {
+
+/** \class DistributedPopulation
+*
+* A single population whose individuals are divided among MPI ranks, for populations too large for one 
+* node's memory.  Rank r owns a contiguous block of rows [rank_offsets[r], rank_offsets[r+1]) of the global
+* trait matrix, and holds only that block of the current and previous generations.  
+*
+* In each step every rank draws the global parent of each of its individuals, sorts the requests by the 
+* rank owning the parent, and batched all-to-all exchanges send each owner the rows it must serve and
+* return those rows.  The exchange runs in rounds of at most EXCHANGE_ROUND_ROWS individuals, so its buffers
+* stay a fixed size however large the local block, and trait memory stays at the two generations' blocks.
+* Innovations are drawn locally (Poisson with mean local size * rate), and new trait IDs come from per-rank
+* blocks of TRAIT_ID_BLOCK IDs, rank r taking blocks r, r + nranks, r + 2 * nranks ..., so IDs never collide
+* without any communication.  Tabulation counts each locus sparsely and gathers the counts of traits 
+* present on rank 0.
+*
+* Built without USE_MPI, or on one rank, this behaves as an ordinary single-process population.  
+*/
+
+class DistributedPopulation {
+private:
+	int popsize;
+	int numloci;
+	int inittraits;
+	double innovation_rate;
+	int generation = 0;
+	bool seeded = false;
+	uint64_t seed_value = 0;
+
+	int rank;
+	int nranks;
+	int local_size;
+	int local_offset;
+	std::vector<int> rank_offsets;
+
+	std::mt19937_64 mt;
+	std::poisson_distribution<int> poisson_dist;
+	std::uniform_int_distribution<int> uniform_local;
+	std::uniform_int_distribution<int> uniform_locus;
+
+	int* population_traits = nullptr;
+	int* prev_population_traits = nullptr;
+	int* parents = nullptr;
+
+	// per locus, the next ID to hand out from this rank's current block, the end of that block, and the
+	// number of blocks this rank has taken
+	std::vector<int> next_trait;
+	std::vector<int> block_end;
+	std::vector<int> blocks_taken;
+
+	// parent exchange, one round at a time:  request_order lists the round's local individuals grouped by 
+	// the rank owning their parent
+	std::vector<int> send_counts;
+	std::vector<int> send_displs;
+	std::vector<int> recv_counts;
+	std::vector<int> recv_displs;
+	std::vector<int> request_order;
+	std::vector<int> outgoing_requests;
+	std::vector<int> incoming_requests;
+	std::vector<int> served_rows;
+	std::vector<int> fetched_rows;
+
+#if defined(USE_MPI)
+	MPI_Comm comm;
+	MPI_Datatype row_type;
+#endif
+
+	int owner_of(int global_indiv);
+	void fetch_parent_rows();
+	void fetch_parent_rows_round(int first, int count);
+	int new_trait(int locus);
+
+public:
+	DistributedPopulation(int p, int n, int i, double r);
+	~DistributedPopulation();
+
+	/**
+	* Sets up this rank's block of individuals with uniform random initial traits, as Population::initialize()
+	* does for the whole population.  Must be called on every rank.
+	*/
+	void initialize();
+
+	/**
+	* Seeds the random number engines for the next initialize().  Each rank derives its own stream from 
+	* the seed and its rank.
+	*/
+	void set_seed(uint64_t seed) { seeded = true; seed_value = seed; }
+
+	/** One step of Wright-Fisher copying without innovation; collective over all ranks. */
+	void step_basicwf();
+
+	/** One step of Wright-Fisher copying with infinite-alleles innovation; collective over all ranks. */
+	void step_wfia();
+
+	/**
+	* Tabulates trait counts over the whole population; collective over all ranks.  The counts are summed
+	* on rank 0, which receives the TraitFrequencies (with compact columns in increasing trait order, see
+	* TraitFrequencies), while other ranks receive an empty pointer.  
+	*/
+	std::shared_ptr<TraitFrequencies> tabulate_trait_counts();
+
+	int get_generation() { return generation; }
+	int get_rank() { return rank; }
+	int get_local_size() { return local_size; }
+};
+
+};
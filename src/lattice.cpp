@@ -0,0 +1,357 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <string.h>
+#include <spdlog/spdlog.h>
+
+#include "lattice.h"
+#include "network.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+namespace spd = spdlog;
+
+
+
+namespace CTModels {
+
+// cells along each side of a tile
+static const int TILE_EDGE = 16;
+
+// decorrelates the hashes choosing jump destinations from those choosing neighbors
+static const uint64_t JUMP_SALT = 0x5bd1e9955bd1e995ULL;
+
+
+LatticePopulation::LatticePopulation(int w, int h, int d, int n, int i, double r, neighborhoodtype nb, double jump)
+	: width(w), height(h), depth(d), numloci(n), inittraits(i), innovation_rate(r), neighborhood(nb), jump_rate(jump) {
+	popsize = width * height * depth;
+	tile_z = (depth > 1) ? TILE_EDGE : 1;
+	halo_z = (depth > 1) ? 1 : 0;
+	tiles_x = (width + TILE_EDGE - 1) / TILE_EDGE;
+	tiles_y = (height + TILE_EDGE - 1) / TILE_EDGE;
+	tiles_z = (depth + tile_z - 1) / tile_z;
+	num_tiles = tiles_x * tiles_y * tiles_z;
+	pad_x = TILE_EDGE + 2;
+	pad_y = TILE_EDGE + 2;
+	plane_size = (size_t)pad_x * pad_y * (tile_z + 2 * halo_z);
+	tile_size = plane_size * numloci;
+	jump_threshold = (uint64_t)(jump_rate * 4294967296.0);
+
+	// the neighborhood as offsets within a padded plane, including the cell itself:  with synchronous 
+	// updates and no self copy, a von Neumann lattice is bipartite and its two checkerboard sublattices 
+	// would evolve independently, never correlating adjacent cells
+	int reach_z = (depth > 1) ? 1 : 0;
+	for(int dz = -reach_z; dz <= reach_z; dz++) {
+		for(int dy = -1; dy <= 1; dy++) {
+			for(int dx = -1; dx <= 1; dx++) {
+				int manhattan = abs(dx) + abs(dy) + abs(dz);
+				if(neighborhood == VON_NEUMANN && manhattan > 1) continue;
+				stencil.push_back((dz * pad_y + dy) * pad_x + dx);
+			}
+		}
+	}
+
+	size_t bufsize = tile_size * num_tiles * sizeof(int);
+	traits = (int*) ALIGNED_MALLOC(bufsize);
+	prev_traits = (int*) ALIGNED_MALLOC(bufsize);
+	memset(traits, 0, bufsize);
+	memset(prev_traits, 0, bufsize);
+	build_halo_map();
+}
+
+
+LatticePopulation::~LatticePopulation() {
+	FREE(traits);
+	FREE(prev_traits);
+}
+
+
+size_t LatticePopulation::cell_offset(int x, int y, int z) {
+	int tile = ((z / tile_z) * tiles_y + y / TILE_EDGE) * tiles_x + x / TILE_EDGE;
+	int lx = x % TILE_EDGE;
+	int ly = y % TILE_EDGE;
+	int lz = z % tile_z;
+	return tile * tile_size + ((size_t)(lz + halo_z) * pad_y + ly + 1) * pad_x + lx + 1;
+}
+
+
+void LatticePopulation::build_halo_map() {
+	// every halo cell of every tile, with the interior cell (wrapping around the lattice) it mirrors;
+	// a tile at the far edge of a lattice whose sides are not multiples of TILE_EDGE is only partly 
+	// filled, and its halo sits just past its last cells
+	halo_targets.clear();
+	halo_sources.clear();
+	for(int tile = 0; tile < num_tiles; tile++) {
+		int tx = tile % tiles_x;
+		int ty = (tile / tiles_x) % tiles_y;
+		int tz = tile / (tiles_x * tiles_y);
+		int ex = std::min(TILE_EDGE, width - tx * TILE_EDGE);
+		int ey = std::min(TILE_EDGE, height - ty * TILE_EDGE);
+		int ez = std::min(tile_z, depth - tz * tile_z);
+		for(int lz = -halo_z; lz < ez + halo_z; lz++) {
+			for(int ly = -1; ly <= ey; ly++) {
+				for(int lx = -1; lx <= ex; lx++) {
+					if(lx >= 0 && lx < ex && ly >= 0 && ly < ey && lz >= 0 && lz < ez) continue;
+					int gx = (tx * TILE_EDGE + lx + width) % width;
+					int gy = (ty * TILE_EDGE + ly + height) % height;
+					int gz = (tz * tile_z + lz + depth) % depth;
+					halo_targets.push_back(tile * tile_size + ((size_t)(lz + halo_z) * pad_y + ly + 1) * pad_x + lx + 1);
+					halo_sources.push_back(cell_offset(gx, gy, gz));
+				}
+			}
+		}
+	}
+}
+
+
+void LatticePopulation::exchange_halos(int* grid) {
+	timer.start("lattice::exchange_halos");
+	int64_t num_halo = (int64_t)halo_targets.size();
+	#pragma omp parallel for schedule(static)
+	for(int64_t i = 0; i < num_halo; i++) {
+		int64_t target = halo_targets[i];
+		int64_t source = halo_sources[i];
+		for(int locus = 0; locus < numloci; locus++) {
+			grid[target + locus * plane_size] = grid[source + locus * plane_size];
+		}
+	}
+	timer.end("lattice::exchange_halos");
+}
+
+
+void LatticePopulation::initialize() {
+	timer.start("lattice::initialize");
+	if(seeded) {
+		this->mt.seed(seed_value);
+	}
+	else {
+		std::random_device rd_mt;
+		this->mt.seed(rd_mt());
+	}
+
+	std::poisson_distribution<int> p{static_cast<double>(popsize) * innovation_rate};
+	poisson_dist = p;
+	std::uniform_int_distribution<int> u{0, popsize - 1};
+	uniform_cell = u;
+	std::uniform_int_distribution<int> l{0, numloci - 1};
+	uniform_locus = l;
+	next_trait.assign(numloci, inittraits + 1);
+	generation = 0;
+
+	uint64_t seed = mt();
+	#pragma omp parallel for schedule(static)
+	for(int z = 0; z < depth; z++) {
+		for(int y = 0; y < height; y++) {
+			for(int x = 0; x < width; x++) {
+				size_t offset = cell_offset(x, y, z);
+				int64_t cell = ((int64_t)z * height + y) * width + x;
+				for(int locus = 0; locus < numloci; locus++) {
+					traits[offset + locus * plane_size] = random_below(hash_random(seed, cell * numloci + locus), inittraits);
+				}
+			}
+		}
+	}
+	memcpy(prev_traits, traits, tile_size * num_tiles * sizeof(int));
+	timer.end("lattice::initialize");
+}
+
+
+void LatticePopulation::step_copy() {
+	std::swap(traits, prev_traits);
+	++generation;
+	exchange_halos(prev_traits);
+
+	timer.start("lattice::step_copy");
+	uint64_t seed = mt();
+	int num_neighbors = (int)stencil.size();
+	const int* offsets = stencil.data();
+
+	#pragma omp parallel for schedule(static)
+	for(int tile = 0; tile < num_tiles; tile++) {
+		int tx = tile % tiles_x;
+		int ty = (tile / tiles_x) % tiles_y;
+		int tz = tile / (tiles_x * tiles_y);
+		int ex = std::min(TILE_EDGE, width - tx * TILE_EDGE);
+		int ey = std::min(TILE_EDGE, height - ty * TILE_EDGE);
+		int ez = std::min(tile_z, depth - tz * tile_z);
+		int* dst_tile = traits + tile * tile_size;
+		const int* src_tile = prev_traits + tile * tile_size;
+		int parent[TILE_EDGE];
+
+		for(int lz = 0; lz < ez; lz++) {
+			for(int ly = 0; ly < ey; ly++) {
+				int row = ((lz + halo_z) * pad_y + ly + 1) * pad_x + 1;
+				int64_t first_cell = ((int64_t)(tz * tile_z + lz) * height + ty * TILE_EDGE + ly) * width + tx * TILE_EDGE;
+
+				#pragma omp simd
+				for(int lx = 0; lx < ex; lx++) {
+					uint64_t r = hash_random(seed, first_cell + lx);
+					parent[lx] = row + lx + offsets[random_below(r, num_neighbors)];
+				}
+				for(int locus = 0; locus < numloci; locus++) {
+					int* dst = dst_tile + locus * plane_size + row;
+					const int* src = src_tile + locus * plane_size;
+					#pragma omp simd
+					for(int lx = 0; lx < ex; lx++) {
+						dst[lx] = src[parent[lx]];
+					}
+				}
+
+				// long-range jumps overwrite the neighborhood copy with a copy of a random cell anywhere;  the low 
+				// half of the same hash decides, so a cell jumps with probability jump_rate independently of its neighbor
+				if(jump_threshold == 0) continue;
+				for(int lx = 0; lx < ex; lx++) {
+					if((hash_random(seed, first_cell + lx) & 0xffffffffULL) >= jump_threshold) continue;
+					int cell = random_below(hash_random(seed ^ JUMP_SALT, first_cell + lx), popsize);
+					size_t from = cell_offset(cell % width, (cell / width) % height, cell / (width * height));
+					for(int locus = 0; locus < numloci; locus++) {
+						dst_tile[locus * plane_size + row + lx] = prev_traits[from + locus * plane_size];
+					}
+				}
+			}
+		}
+	}
+	timer.end("lattice::step_copy");
+}
+
+
+void LatticePopulation::step_basicwf() {
+	step_copy();
+}
+
+
+void LatticePopulation::step_wfia() {
+	step_copy();
+
+	int num_mutations = poisson_dist(this->mt);
+	for(int j = 0; j < num_mutations; j++) {
+		int cell = uniform_cell(this->mt);
+		int locus = uniform_locus(this->mt);
+		size_t offset = cell_offset(cell % width, (cell / width) % height, cell / (width * height));
+		traits[offset + locus * plane_size] = next_trait[locus]++;
+	}
+}
+
+
+std::shared_ptr<TraitFrequencies> LatticePopulation::tabulate_trait_counts(SpatialAutocorrelation* spatial) {
+	timer.start("lattice::tabulate_trait_counts");
+
+	// comparisons with the next cell along each axis reach into the halo at the far side of a tile
+	if(spatial) {
+		exchange_halos(traits);
+	}
+
+	// each thread counts its tiles sparsely, so the cost follows the lattice and the traits present on it
+	// rather than every trait ever introduced
+	std::vector<std::vector<TraitCounter>> thread_counts;
+	std::vector<int64_t> thread_same;
+	int next_y = pad_x;
+	int next_z = pad_x * pad_y;
+
+#pragma omp parallel
+{
+	#pragma omp single
+	{
+		thread_counts.resize(NUM_THREADS(), std::vector<TraitCounter>(numloci));
+		thread_same.assign((size_t)NUM_THREADS() * numloci, 0);
+	}
+	TraitCounter* counts = thread_counts[THREAD_NUM()].data();
+	int64_t* same = thread_same.data() + THREAD_NUM() * numloci;
+
+	#pragma omp for schedule(static)
+	for(int tile = 0; tile < num_tiles; tile++) {
+		int tx = tile % tiles_x;
+		int ty = (tile / tiles_x) % tiles_y;
+		int tz = tile / (tiles_x * tiles_y);
+		int ex = std::min(TILE_EDGE, width - tx * TILE_EDGE);
+		int ey = std::min(TILE_EDGE, height - ty * TILE_EDGE);
+		int ez = std::min(tile_z, depth - tz * tile_z);
+
+		for(int locus = 0; locus < numloci; locus++) {
+			const int* plane = traits + tile * tile_size + locus * plane_size;
+			TraitCounter& locus_counts = counts[locus];
+			int64_t matches = 0;
+			for(int lz = 0; lz < ez; lz++) {
+				for(int ly = 0; ly < ey; ly++) {
+					const int* row = plane + ((lz + halo_z) * pad_y + ly + 1) * pad_x + 1;
+					// neighboring cells often share a trait, so runs along the row are counted at once
+					int run_trait = row[0];
+					int run = 0;
+					for(int lx = 0; lx < ex; lx++) {
+						if(row[lx] == run_trait) {
+							++run;
+						}
+						else {
+							locus_counts.add(run_trait, run);
+							run_trait = row[lx];
+							run = 1;
+						}
+					}
+					locus_counts.add(run_trait, run);
+					if(!spatial) continue;
+					#pragma omp simd reduction(+:matches)
+					for(int lx = 0; lx < ex; lx++) {
+						matches += (row[lx] == row[lx + 1]) + (row[lx] == row[lx + next_y]);
+					}
+					if(halo_z == 0) continue;
+					#pragma omp simd reduction(+:matches)
+					for(int lx = 0; lx < ex; lx++) {
+						matches += (row[lx] == row[lx + next_z]);
+					}
+				}
+			}
+			same[locus] += matches;
+		}
+	}
+
+	#pragma omp for schedule(dynamic)
+	for(int locus = 0; locus < numloci; locus++) {
+		for(size_t t = 1; t < thread_counts.size(); t++) {
+			thread_counts[0][locus].merge(thread_counts[t][locus]);
+		}
+	}
+}
+	std::shared_ptr<TraitFrequencies> tf = compact_trait_frequencies(thread_counts[0]);
+
+	if(spatial) {
+		double pairs = (double)popsize * ((depth > 1) ? 3 : 2);
+		int threads = thread_counts.size();
+		for(int locus = 0; locus < numloci; locus++) {
+			int64_t matches = 0;
+			for(int t = 0; t < threads; t++) matches += thread_same[t * numloci + locus];
+
+			// the Simpson concentration, over the traits present
+			double concentration = 0.0;
+			const int* locus_counts = tf->trait_counts + (size_t)locus * tf->max_num_traits;
+			for(int column = 0; column < tf->max_num_traits; column++) {
+				double freq = (double)locus_counts[column] / popsize;
+				concentration += freq * freq;
+			}
+			double observed = matches / pairs;
+			spatial->same_neighbor_fraction[locus] = observed;
+			spatial->expected_fraction[locus] = concentration;
+			spatial->autocorrelation[locus] = (concentration < 1.0) ? (observed - concentration) / (1.0 - concentration) : 0.0;
+		}
+	}
+	timer.end("lattice::tabulate_trait_counts");
+	return tf;
+}
+
+
+void print_spatial_autocorrelation(const SpatialAutocorrelation& sa) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+		for(int locus = 0; locus < sa.numloci; locus++) {
+			std::stringstream s;
+			s << "spatial autocorrelation @ locus: " << locus << ": " << std::fixed << std::setprecision(4) << sa.autocorrelation[locus];
+			s << " same neighbor: " << sa.same_neighbor_fraction[locus];
+			s << " expected: " << sa.expected_fraction[locus];
+			SPDLOG_DEBUG(clog, "{}", s.str());
+		}
+	}
+}
+
+
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "defines.h"
+#include "statistics.h"
+
+
+namespace CTModels {
+
+enum neighborhoodtype { VON_NEUMANN, MOORE };
+
+/** \class SpatialAutocorrelation
+*
+* Per locus, the fraction of adjacent cell pairs (along each axis, wrapping at the borders) carrying the same 
+* trait, the fraction expected if traits were placed at random (the Simpson concentration, sum of squared
+* trait frequencies), and the autocorrelation (observed - expected) / (1 - expected):  0 for no spatial
+* structure, 1 when every cell matches its neighbors.  
+*/
+
+class SpatialAutocorrelation {
+public:
+	int numloci;
+	std::vector<double> same_neighbor_fraction;
+	std::vector<double> expected_fraction;
+	std::vector<double> autocorrelation;
+
+	SpatialAutocorrelation(int n) : numloci(n), same_neighbor_fraction(n), expected_fraction(n), autocorrelation(n) {}
+};
+
+
+/** \class LatticePopulation
+*
+* A population living on a 2D or 3D periodic lattice, one individual per cell, in which each cell copies a
+* random cell of its von Neumann or Moore neighborhood (the cell itself included), or with probability 
+* jump_rate a random cell anywhere on the lattice (a long-range jump).  
+*
+* The lattice is stored in TILE_EDGE^2 (or ^3) tiles, each a contiguous block holding one padded plane per 
+* locus:  the tile's cells surrounded by a one cell halo copied from the neighboring tiles before each step.
+* With the halo in place every neighbor read of the stencil is a fixed offset within the tile, so a tile 
+* is processed row by row with vectorized random draws and gathers, and OpenMP divides the tiles among threads.  
+* Random draws are counter-based hashes of the step seed and the cell, so results do not depend on the 
+* number of threads.  
+*/
+
+class LatticePopulation {
+private:
+	int width;
+	int height;
+	int depth;
+	int numloci;
+	int inittraits;
+	double innovation_rate;
+	neighborhoodtype neighborhood;
+	double jump_rate;
+	int popsize;
+	int generation = 0;
+	bool seeded = false;
+	uint64_t seed_value = 0;
+
+	// tile geometry:  tile_z and halo_z are 1 and 0 for a 2D lattice, which has no halo above and below
+	int tile_z;
+	int halo_z;
+	int tiles_x;
+	int tiles_y;
+	int tiles_z;
+	int num_tiles;
+	int pad_x;
+	int pad_y;
+	size_t plane_size;
+	size_t tile_size;
+	std::vector<int> stencil;
+	std::vector<int64_t> halo_targets;
+	std::vector<int64_t> halo_sources;
+	uint64_t jump_threshold;
+
+	std::mt19937_64 mt;
+	std::poisson_distribution<int> poisson_dist;
+	std::uniform_int_distribution<int> uniform_cell;
+	std::uniform_int_distribution<int> uniform_locus;
+	std::vector<int> next_trait;
+	int* traits = nullptr;
+	int* prev_traits = nullptr;
+
+	size_t cell_offset(int x, int y, int z);
+	void build_halo_map();
+	void exchange_halos(int* grid);
+	void step_copy();
+
+public:
+	LatticePopulation(int w, int h, int d, int n, int i, double r, neighborhoodtype nb, double jump);
+	~LatticePopulation();
+
+	/** Sets up the lattice with uniform random initial traits, as Population::initialize() does. */
+	void initialize();
+
+	/** Seeds the random number engines for the next initialize(). */
+	void set_seed(uint64_t seed) { seeded = true; seed_value = seed; }
+
+	/** One step of copying from the neighborhood, without innovation. */
+	void step_basicwf();
+
+	/** One step of copying from the neighborhood, with infinite-alleles innovation. */
+	void step_wfia();
+
+	/**
+	* Tabulates trait counts over the whole lattice, tile by tile in parallel, into sparse per-thread counters;
+	* the result has compact columns (see TraitFrequencies).  If spatial is given, the autocorrelation of each
+	* locus is measured in the same sweep, comparing each cell with its next cell along each axis.  
+	*/
+	std::shared_ptr<TraitFrequencies> tabulate_trait_counts(SpatialAutocorrelation* spatial = nullptr);
+
+	/** Returns the trait of the cell at (x, y, z) at a locus. */
+	int trait_at(int x, int y, int z, int locus) { return traits[cell_offset(x, y, z) + locus * plane_size]; }
+
+	int get_generation() { return generation; }
+	int get_popsize() { return popsize; }
+};
+
+
+void print_spatial_autocorrelation(const SpatialAutocorrelation& sa);
+
+};
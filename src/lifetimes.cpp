@@ -0,0 +1,147 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+#include "lifetimes.h"
+#include "statistics.h"
+#include "globals.h"
+#include "timer.h"
+
+namespace spd = spdlog;
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+void TraitRegistry::record_origin(int locus, int trait, int generation) {
+	std::vector<TraitRecord>& records = records_by_locus[locus];
+	if(trait >= (int)records.size()) {
+		records.resize(trait + 1, TraitRecord{-1, -1, 0, -1, false});
+	}
+	records[trait] = TraitRecord{generation, -1, 0, -1, false};
+	living_by_locus[locus].push_back(trait);
+}
+
+
+void TraitRegistry::register_present(std::shared_ptr<TraitFrequencies> tf, int generation) {
+	for(int locus = 0; locus < numloci; locus++) {
+		int* row = tf->trait_counts + (size_t)locus * tf->max_num_traits;
+		for(int trait = 0; trait < tf->max_num_traits; trait++) {
+			if(row[trait] > 0) {
+				record_origin(locus, trait, generation);
+				TraitRecord& rec = records_by_locus[locus][trait];
+				rec.initial = true;
+				rec.max_count = row[trait];
+				rec.max_count_generation = generation;
+			}
+		}
+	}
+}
+
+
+void TraitRegistry::observe(std::shared_ptr<TraitFrequencies> tf, int generation) {
+	timer.start("lifetimes::observe");
+	for(int locus = 0; locus < numloci; locus++) {
+		int* row = tf->trait_counts + (size_t)locus * tf->max_num_traits;
+		std::vector<TraitRecord>& records = records_by_locus[locus];
+		std::vector<int>& living = living_by_locus[locus];
+
+		// swap-remove extinct traits from the living list, so it stays dense
+		size_t i = 0;
+		while(i < living.size()) {
+			int trait = living[i];
+			int count = (trait < tf->max_num_traits) ? row[trait] : 0;
+			TraitRecord& rec = records[trait];
+			if(count > rec.max_count) {
+				rec.max_count = count;
+				rec.max_count_generation = generation;
+			}
+			if(count == 0) {
+				rec.extinction_generation = generation;
+				living[i] = living.back();
+				living.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+	}
+	timer.end("lifetimes::observe");
+}
+
+
+void print_trait_lifetimes(std::shared_ptr<TraitRegistry> registry, int current_generation, int popsize) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+
+		for(int locus = 0; locus < registry->get_numloci(); locus++) {
+			const std::vector<TraitRecord>& records = registry->records(locus);
+			long total_extinct_duration = 0;
+			int num_extinct = 0;
+			int num_recorded = 0;
+
+			for(size_t trait = 0; trait < records.size(); trait++) {
+				const TraitRecord& rec = records[trait];
+				if(rec.origin_generation < 0) continue;
+				++num_recorded;
+
+				int end = (rec.extinction_generation >= 0) ? rec.extinction_generation : current_generation;
+				int duration = end - rec.origin_generation;
+				if(rec.extinction_generation >= 0 && !rec.initial) {
+					total_extinct_duration += duration;
+					++num_extinct;
+				}
+
+				if(clog->level() == spd::level::trace) {
+					std::stringstream s;
+					s << "lifetime @ locus: " << locus << " trait: " << trait;
+					s << " origin: " << rec.origin_generation << " extinct: " << rec.extinction_generation;
+					s << " duration: " << duration;
+					s << " max freq: " << std::fixed << std::setprecision(6) << (double)rec.max_count / popsize;
+					s << (rec.initial ? " (initial)" : "");
+					SPDLOG_TRACE(clog,"{}",s.str());
+				}
+			}
+
+			std::stringstream s;
+			s << "lifetimes @ locus: " << locus << ": traits: " << num_recorded;
+			s << " living: " << registry->num_living(locus) << " extinct innovations: " << num_extinct;
+			s << " mean sojourn: " << std::fixed << std::setprecision(2);
+			s << ((num_extinct > 0) ? (double)total_extinct_duration / num_extinct : 0.0);
+			SPDLOG_DEBUG(clog,"{}",s.str());
+		}
+	}
+}
+
+
+bool write_trait_lifetimes(std::shared_ptr<TraitRegistry> registry, int current_generation, int popsize, const std::string& path) {
+	FILE* out = fopen(path.c_str(), "w");
+	if(out == NULL) {
+		clog->error("cannot open lifetime output {}", path);
+		return false;
+	}
+	fprintf(out, "locus\ttrait\torigin\textinction\tduration\tmax_count\tmax_freq\tmax_generation\tinitial\n");
+	for(int locus = 0; locus < registry->get_numloci(); locus++) {
+		const std::vector<TraitRecord>& records = registry->records(locus);
+		for(size_t trait = 0; trait < records.size(); trait++) {
+			const TraitRecord& rec = records[trait];
+			if(rec.origin_generation < 0) continue;
+			int end = (rec.extinction_generation >= 0) ? rec.extinction_generation : current_generation;
+			fprintf(out, "%d\t%d\t%d\t%d\t%d\t%d\t%.6f\t%d\t%d\n", locus, (int)trait, rec.origin_generation,
+				rec.extinction_generation, end - rec.origin_generation, rec.max_count, (double)rec.max_count / popsize,
+				rec.max_count_generation, rec.initial ? 1 : 0);
+		}
+	}
+	bool ok = !ferror(out);
+	ok = (fclose(out) == 0) && ok;
+	if(!ok) {
+		clog->error("failed writing lifetime output {}", path);
+	}
+	return ok;
+}
+
+
+};
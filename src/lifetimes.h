@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include "defines.h"
+#include "statistics.h"
+
+
+namespace CTModels {
+
+/** \struct TraitRecord
+*
+* Origin and fate of a single trait at a locus.  Generations count completed Population steps.  A trait 
+* which is still present has extinction_generation of -1, and one which was already present when tracking 
+* began has initial set, since its true origin is unknown.  max_count is the largest count seen at any 
+* observation, and max_count_generation the generation of the first observation reaching it.  
+*/
+
+struct TraitRecord {
+	int origin_generation;
+	int extinction_generation;
+	int max_count;
+	int max_count_generation;
+	bool initial;
+};
+
+
+
+/** \class TraitRegistry
+*
+* TraitRegistry tracks the lifetime of every trait handed out by a Population.  Records are indexed directly 
+* by trait ID within each locus, since IDs are dense and never reused, and a compact list of the living traits 
+* at each locus keeps each observation proportional to current richness rather than to the number of traits 
+* ever seen.  Origins are recorded at mutation time by Population::step_wfia(), and each call to 
+* Population::tabulate_trait_counts() passes the new counts to observe(), which updates maximum counts and 
+* retires traits whose count has fallen to zero.  Extinction times are therefore resolved to the interval 
+* between tabulations.
+*/
+
+class TraitRegistry {
+private:
+	int numloci;
+	std::vector<std::vector<TraitRecord>> records_by_locus;
+	std::vector<std::vector<int>> living_by_locus;
+
+public:
+	TraitRegistry(int numloci) : numloci(numloci), records_by_locus(numloci), living_by_locus(numloci) {}
+
+	/**
+	* Records every trait with a nonzero count as alive at the given generation, flagged as initial.
+	*/
+	void register_present(std::shared_ptr<TraitFrequencies> tf, int generation);
+
+	/**
+	* Records the origin of a newly innovated trait.
+	*/
+	void record_origin(int locus, int trait, int generation);
+
+	/**
+	* Updates maximum counts of living traits from a fresh tabulation, and marks those no longer present as 
+	* extinct at this generation.
+	*/
+	void observe(std::shared_ptr<TraitFrequencies> tf, int generation);
+
+	int get_numloci() { return numloci; }
+	const std::vector<TraitRecord>& records(int locus) { return records_by_locus[locus]; }
+	int num_living(int locus) { return living_by_locus[locus].size(); }
+};
+
+
+/* Defined in lifetimes.cpp */
+
+/**
+* Logs the lifetime table, one line per trait with its locus, ID, origin, extinction, duration and 
+* maximum frequency (at trace level), and a per-locus summary of mean sojourn times (at debug level). 
+* Durations of traits still alive are measured to the given current generation.   
+*/
+void print_trait_lifetimes(std::shared_ptr<TraitRegistry> registry, int current_generation, int popsize);
+
+/**
+* Writes the lifetime table to a tab-separated file, one row per trait with its locus, ID, origin, extinction
+* (-1 if still alive), duration, maximum count, its frequency and generation, and whether it was initial.  
+* Returns false if the file cannot be written.
+*/
+bool write_trait_lifetimes(std::shared_ptr<TraitRegistry> registry, int current_generation, int popsize, const std::string& path);
+
+};
@@ -2,6 +2,7 @@
 #include <random>	
 #include <chrono>
 #include <ratio>
+#include <cmath>
 #include <sstream>
 #include <memory>
 
@@ -10,6 +11,26 @@
 
 #include "population.h"
 #include "statistics.h"
+#include "neutrality.h"
+#include "assemblage.h"
+#include "lifetimes.h"
+#include "topk.h"
+#include "configurations.h"
+#include "classification.h"
+#include "association.h"
+#include "sampler.h"
+#include "columnar.h"
+#include "checkpoint.h"
+#include "statedump.h"
+#include "batch.h"
+#include "scheduler.h"
+#include "sweep.h"
+#include "mpisession.h"
+#include "mpisweep.h"
+#include "distpopulation.h"
+#include "network.h"
+#include "lattice.h"
+#include "metapopulation.h"
 #include "defines.h"
 #include "timer.h"
 #include "globals.h"
@@ -20,15 +41,57 @@ namespace spd = spdlog;
 
 
 
-enum ruletype { BASICWF, WFIA };
-
 int main(int argc, char** argv) {
+	MpiSession mpi(&argc, &argv);
 	std::string VERSION = "0.0.1";
 	int popsize;
 	double innovrate = 10000.0;
 	int numloci;
 	int simlength;
 	int inittraits;
+	int neutralityreps;
+	std::vector<int> samplesizes;
+	bool withreplacement;
+	int windowlength;
+	int windowstep;
+	int lifetimeinterval;
+	std::string lifetimeoutput;
+	int topk;
+	bool approxtopk;
+	int configurations;
+	std::vector<std::string> classificationfiles;
+	int associationsample;
+	int sampleinterval;
+	std::string sampleoutput;
+	bool samplecounts;
+	int sampleindividuals;
+	std::string sampleformat;
+	std::string checkpointfile;
+	int checkpointinterval;
+	std::string restartfile;
+	int dumpinterval;
+	std::string dumpfile;
+	int replicates;
+	std::string batchfile;
+	std::string batchoutput;
+	bool adaptive;
+	int memorybudget;
+	int calibrationgens;
+	std::string sweepfile;
+	std::string sweephistory;
+	std::string sweepstate;
+	bool distributed;
+	std::string networktype;
+	std::string networklayout;
+	double rewiringrate;
+	std::string latticedims;
+	std::string neighborhood;
+	double jumprate;
+	int numdemes;
+	double migrationrate;
+	std::string edgelist;
+	double networkdegree;
+	double rewiring;
 	std::string logfile;
 	int debug;
 	std::random_device rd;
@@ -48,6 +111,27 @@ int main(int argc, char** argv) {
 		allowed_types.push_back("wfia");
 		TCLAP::ValuesConstraint<std::string> allowedVals( allowed_types );
 
+		vector<std::string> network_types;
+		network_types.push_back("none");
+		network_types.push_back("lattice");
+		network_types.push_back("random");
+		network_types.push_back("smallworld");
+		network_types.push_back("scalefree");
+		network_types.push_back("file");
+		TCLAP::ValuesConstraint<std::string> allowedNetworks( network_types );
+
+		vector<std::string> network_layouts;
+		network_layouts.push_back("natural");
+		network_layouts.push_back("rcm");
+		network_layouts.push_back("degree");
+		network_layouts.push_back("hilbert");
+		TCLAP::ValuesConstraint<std::string> allowedLayouts( network_layouts );
+
+		vector<std::string> neighborhoods;
+		neighborhoods.push_back("vonneumann");
+		neighborhoods.push_back("moore");
+		TCLAP::ValuesConstraint<std::string> allowedNeighborhoods( neighborhoods );
+
 		TCLAP::CmdLine cmd("Neutral Cultural Transmission in C++ Framework", ' ', VERSION);
 
 		TCLAP::ValueArg<int> p("p","popsize","Population size",true,100,"integer");
@@ -57,6 +141,53 @@ int main(int argc, char** argv) {
 		TCLAP::ValueArg<int> it("t","inittraits","Number of initial traits present at each dimension/locus",true,4,"integer");
 		TCLAP::ValueArg<int> d("d", "debug", "Set debugging level, with 0 or absence indicating debug output is off, 1 indicating debug, >1 indicating TRACE",false,0,"integer");
 		TCLAP::ValueArg<std::string> t("r","ruletype", "Copying rule to use",true,"basicwf",&allowedVals);
+		vector<std::string> allowed_formats;
+		allowed_formats.push_back("text");
+		allowed_formats.push_back("columnar");
+		TCLAP::ValuesConstraint<std::string> allowedFormats( allowed_formats );
+		TCLAP::ValueArg<int> nr("n","neutralityreps","Number of Monte Carlo replicates for Ewens-Watterson and Slatkin neutrality tests, 0 to skip the tests",false,0,"integer");
+		TCLAP::MultiArg<int> ss("z","samplesize","Also tabulate statistics for a random sample of this many individuals at the end of the run; may be repeated for nested samples of several sizes",false,"integer");
+		TCLAP::SwitchArg sr("w","withreplacement","Draw samples with replacement instead of without", false);
+		TCLAP::ValueArg<int> wl("a","windowlength","Length in generations of time-averaged assemblage windows, 0 for no time averaging",false,0,"integer");
+		TCLAP::ValueArg<int> ws("b","windowstep","Generations between the starts of successive assemblage windows; defaults to the window length (non-overlapping windows)",false,0,"integer");
+		TCLAP::ValueArg<int> li("g","lifetimeinterval","Track trait origins and extinctions, tabulating every this many generations (1 for exact lifetimes), 0 to skip",false,0,"integer");
+		TCLAP::ValueArg<std::string> lo("","lifetimeoutput","Path of a tab-separated table of every tracked trait's origin, extinction and maximum frequency, written at the end of the run; requires lifetimeinterval",false,"","string");
+		TCLAP::ValueArg<int> tk("k","topk","Report the k most frequent traits at each locus and the turnover of that list over the run, 0 to skip",false,0,"integer");
+		TCLAP::SwitchArg atk("x","approxtopk","Find top traits with a Space-Saving sketch instead of exact counts", false);
+		TCLAP::ValueArg<int> cfg("c","configurations","Count distinct multi-locus trait configurations at the end of the run: 1 for exact counts, 2 for a HyperLogLog estimate, 0 to skip",false,0,"integer");
+		TCLAP::MultiArg<std::string> cls("m","classification","File of per-locus trait-to-mode tables defining a paradigmatic classification to apply at the end of the run; may be repeated",false,"string");
+		TCLAP::ValueArg<int> as("e","associations","Calculate pairwise trait association between loci at the end of the run, over a sample of this many individuals, or the whole population if -1; 0 to skip",false,0,"integer");
+		TCLAP::ValueArg<int> si("q","sampleinterval","Record a time series of statistics every this many generations, 0 for no time series",false,0,"integer");
+		TCLAP::ValueArg<std::string> so("o","sampleoutput","Path of the time series output file",false,"timeseries.txt","string");
+		TCLAP::ValueArg<int> sn("y","sampleindividuals","Compute time series statistics from a random sample of this many individuals instead of the whole population, 0 for the whole population",false,0,"integer");
+		TCLAP::ValueArg<std::string> sf("j","sampleformat","Format of the time series output",false,"text",&allowedFormats);
+		TCLAP::SwitchArg sc("u","samplecounts","Include full trait counts in each time series sample", false);
+		TCLAP::ValueArg<std::string> cp("C","checkpoint","Path of a checkpoint file, rewritten every checkpointinterval generations",false,"","string");
+		TCLAP::ValueArg<int> ci("I","checkpointinterval","Generations between checkpoints, 0 for no checkpoints",false,0,"integer");
+		TCLAP::ValueArg<std::string> rs("R","restart","Resume from this checkpoint file instead of a new population; population parameters come from the checkpoint",false,"","string");
+		TCLAP::ValueArg<int> di("D","dumpinterval","Write the full population state every this many generations to a compressed state dump, 0 for none",false,0,"integer");
+		TCLAP::ValueArg<std::string> df("S","dumpfile","Path of the compressed population state dump",false,"states.bin","string");
+		TCLAP::ValueArg<int> nrep("N","replicates","Run this many replicates in one process and write final statistics to the batch output, 0 for a single ordinary run",false,0,"integer");
+		TCLAP::ValueArg<std::string> bf("B","batchfile","File of configurations (popsize numloci inittraits innovrate rule simlength per line) to run in batch, in place of the command line parameters",false,"","string");
+		TCLAP::ValueArg<std::string> bo("O","batchoutput","Path of the batch results file",false,"batch.txt","string");
+		TCLAP::SwitchArg ad("A","adaptive","In batch mode, run several replicates at once, choosing replicates in flight and threads per replicate for each configuration", false);
+		TCLAP::ValueArg<int> mb("M","memorybudget","Memory budget in megabytes for replicates running at once in adaptive batch mode, 0 for no limit",false,0,"integer");
+		TCLAP::ValueArg<int> cg("G","calibrate","Calibrate adaptive batch scheduling by timing this many generations at each thread count, 0 to use the cost model",false,0,"integer");
+		TCLAP::ValueArg<std::string> sw("P","sweep","Run the parameter sweep described in this file, writing results to the batch output",false,"","string");
+		TCLAP::ValueArg<std::string> sh("H","sweephistory","File of past replicate timings used to order sweep jobs, appended to after the sweep",false,"","string");
+		TCLAP::ValueArg<std::string> ssd("K","sweepstate","Existing directory holding the manifest, completed job index and checkpoints that make a sweep resumable; checkpoints are written every checkpointinterval generations",false,"","string");
+		TCLAP::SwitchArg dist("X","distributed","Divide the individuals of one population among MPI ranks, for populations too large for one node; reports final statistics only", false);
+		TCLAP::ValueArg<std::string> nt("T","network","Network on which individuals copy random neighbors instead of the whole population: a square torus lattice, Erdos-Renyi random graph, Watts-Strogatz small world, Barabasi-Albert scale-free graph, or the edge list given by edgelist",false,"none",&allowedNetworks);
+		TCLAP::ValueArg<std::string> el("E","edgelist","Path of an edge list (pairs of 0-based individual IDs) for the file network",false,"","string");
+		TCLAP::ValueArg<double> nd("V","degree","Mean degree of generated random, small world and scale-free networks",false,4.0,"double");
+		TCLAP::ValueArg<double> rw("W","rewiring","Probability of rewiring each edge of a small world network",false,0.1,"double");
+		TCLAP::ValueArg<std::string> nly("L","layout","Renumber network individuals in memory for locality: reverse Cuthill-McKee, decreasing degree, or a Hilbert curve (lattice only); IDs in output files are unchanged",false,"natural",&allowedLayouts);
+		TCLAP::ValueArg<double> rr("F","rewiringrate","Fraction of network edges rewired to random individuals every generation, making the network dynamic",false,0.0,"double");
+		TCLAP::ValueArg<std::string> lat("U","lattice","Place one individual on each cell of a periodic lattice of these dimensions (e.g., 1000x1000 or 100x100x100), in place of popsize; reports final statistics and spatial autocorrelation",false,"","string");
+		TCLAP::ValueArg<std::string> nbh("Y","neighborhood","Lattice neighborhood from which cells copy",false,"vonneumann",&allowedNeighborhoods);
+		TCLAP::ValueArg<double> jr("Z","jumprate","Probability that a lattice cell copies a random cell anywhere on the lattice instead of a neighbor",false,0.0,"double");
+		TCLAP::ValueArg<int> dm("J","demes","Divide the population into this many demes of popsize / demes individuals (popsize must be a multiple of demes), linked by island model migration; reports final statistics within and among demes",false,0,"integer");
+		TCLAP::ValueArg<double> mr("Q","migrationrate","Probability per generation that an individual of a deme is replaced by an immigrant from another deme",false,0.01,"double");
 		TCLAP::ValueArg<std::string> f("f","logfile","Path to log file and filename (e.g., /tmp/test.log",false,"","string");
 
 
@@ -67,6 +198,49 @@ int main(int argc, char** argv) {
 		cmd.add(it);
 		cmd.add(d);
 		cmd.add(f);
+		cmd.add(nr);
+		cmd.add(ss);
+		cmd.add(sr);
+		cmd.add(wl);
+		cmd.add(ws);
+		cmd.add(li);
+		cmd.add(lo);
+		cmd.add(tk);
+		cmd.add(atk);
+		cmd.add(cfg);
+		cmd.add(cls);
+		cmd.add(as);
+		cmd.add(si);
+		cmd.add(so);
+		cmd.add(sc);
+		cmd.add(sn);
+		cmd.add(sf);
+		cmd.add(cp);
+		cmd.add(ci);
+		cmd.add(rs);
+		cmd.add(di);
+		cmd.add(df);
+		cmd.add(nrep);
+		cmd.add(bf);
+		cmd.add(bo);
+		cmd.add(ad);
+		cmd.add(mb);
+		cmd.add(cg);
+		cmd.add(sw);
+		cmd.add(sh);
+		cmd.add(ssd);
+		cmd.add(dist);
+		cmd.add(nt);
+		cmd.add(el);
+		cmd.add(nd);
+		cmd.add(rw);
+		cmd.add(nly);
+		cmd.add(rr);
+		cmd.add(lat);
+		cmd.add(nbh);
+		cmd.add(jr);
+		cmd.add(dm);
+		cmd.add(mr);
 		cmd.add(t);
 		cmd.parse( argc, argv );
 
@@ -77,6 +251,49 @@ int main(int argc, char** argv) {
 		simlength = len.getValue();
 		debug = d.getValue();
 		logfile = f.getValue();
+		neutralityreps = nr.getValue();
+		samplesizes = ss.getValue();
+		withreplacement = sr.getValue();
+		windowlength = wl.getValue();
+		windowstep = (ws.getValue() > 0) ? ws.getValue() : windowlength;
+		lifetimeinterval = li.getValue();
+		lifetimeoutput = lo.getValue();
+		topk = tk.getValue();
+		approxtopk = atk.getValue();
+		configurations = cfg.getValue();
+		classificationfiles = cls.getValue();
+		associationsample = as.getValue();
+		sampleinterval = si.getValue();
+		sampleoutput = so.getValue();
+		samplecounts = sc.getValue();
+		sampleindividuals = sn.getValue();
+		sampleformat = sf.getValue();
+		checkpointfile = cp.getValue();
+		checkpointinterval = ci.getValue();
+		restartfile = rs.getValue();
+		dumpinterval = di.getValue();
+		dumpfile = df.getValue();
+		replicates = nrep.getValue();
+		batchfile = bf.getValue();
+		batchoutput = bo.getValue();
+		adaptive = ad.getValue();
+		memorybudget = mb.getValue();
+		calibrationgens = cg.getValue();
+		sweepfile = sw.getValue();
+		sweephistory = sh.getValue();
+		sweepstate = ssd.getValue();
+		distributed = dist.getValue();
+		networktype = nt.getValue();
+		edgelist = el.getValue();
+		networkdegree = nd.getValue();
+		rewiring = rw.getValue();
+		networklayout = nly.getValue();
+		rewiringrate = rr.getValue();
+		latticedims = lat.getValue();
+		neighborhood = nbh.getValue();
+		jumprate = jr.getValue();
+		numdemes = dm.getValue();
+		migrationrate = mr.getValue();
 		std::string rule = t.getValue();
 		if(rule == "basicwf") {
 			CTModels::clog->debug("Using basicwf ruletype");
@@ -102,34 +319,403 @@ int main(int argc, char** argv) {
 
 	timer.start("main");
 
-	Population* pop = new Population(popsize, numloci, inittraits, innovrate);
-	SPDLOG_TRACE(CTModels::clog, "Constructed population: {}", pop->dbg_params());
-	pop->initialize();
+	if(distributed) {
+		DistributedPopulation dpop(popsize, numloci, inittraits, innovrate);
+		dpop.initialize();
+		SPDLOG_DEBUG(CTModels::clog, "Rank {} of {} holds {} individuals", mpi.rank(), mpi.size(), dpop.get_local_size());
+		switch(rt) {
+			case BASICWF :
+				while(dpop.get_generation() < simlength) dpop.step_basicwf();
+				break;
+			case WFIA :
+				while(dpop.get_generation() < simlength) dpop.step_wfia();
+				break;
+		}
+
+		// counts are reduced onto rank 0, which alone reports
+		auto dtf = dpop.tabulate_trait_counts();
+		timer.end("main");
+		if(mpi.is_root()) {
+			print_trait_statistics(calculate_trait_statistics(dtf));
+			print_event_timing();
+		}
+		return 0;
+	}
+
+	if(!latticedims.empty()) {
+		int lw = 0, lh = 0, ld = 1;
+		int dims = sscanf(latticedims.c_str(), "%dx%dx%d", &lw, &lh, &ld);
+		if(dims < 2 || lw <= 0 || lh <= 0 || ld <= 0) {
+			CTModels::clog->error("lattice dimensions {} should be WxH or WxHxD", latticedims);
+			return 1;
+		}
+		LatticePopulation lpop(lw, lh, ld, numloci, inittraits, innovrate, (neighborhood == "moore") ? MOORE : VON_NEUMANN, jumprate);
+		lpop.initialize();
+		SPDLOG_DEBUG(CTModels::clog, "Lattice of {} cells", lpop.get_popsize());
+		switch(rt) {
+			case BASICWF :
+				while(lpop.get_generation() < simlength) lpop.step_basicwf();
+				break;
+			case WFIA :
+				while(lpop.get_generation() < simlength) lpop.step_wfia();
+				break;
+		}
+
+		SpatialAutocorrelation spatial(numloci);
+		auto ltf = lpop.tabulate_trait_counts(&spatial);
+		timer.end("main");
+		print_trait_statistics(calculate_trait_statistics(ltf));
+		print_spatial_autocorrelation(spatial);
+		print_event_timing();
+		return 0;
+	}
+
+	if(numdemes > 0) {
+		if(popsize < numdemes) {
+			CTModels::clog->error("population of {} is too small for {} demes", popsize, numdemes);
+			return 1;
+		}
+		if(popsize % numdemes != 0) {
+			CTModels::clog->error("population of {} does not divide into {} equal demes", popsize, numdemes);
+			return 1;
+		}
+		Metapopulation meta(numdemes, popsize / numdemes, numloci, inittraits, innovrate, migrationrate);
+		meta.initialize();
+		SPDLOG_DEBUG(CTModels::clog, "Metapopulation of {} demes of {} individuals", numdemes, popsize / numdemes);
+		switch(rt) {
+			case BASICWF :
+				while(meta.get_generation() < simlength) meta.step_basicwf();
+				break;
+			case WFIA :
+				while(meta.get_generation() < simlength) meta.step_wfia();
+				break;
+		}
+
+		DemeStatistics demestats(numdemes, numloci);
+		auto mtf = meta.tabulate_trait_counts(&demestats);
+		timer.end("main");
+		print_trait_statistics(calculate_trait_statistics(mtf));
+		print_deme_statistics(demestats);
+		print_event_timing();
+		return 0;
+	}
 
+	if(!sweepfile.empty()) {
+		// every rank must get through setup before any enters the sweep, or the others wait on it forever
+		auto spec = SweepSpec::from_file(sweepfile);
+		bool ok = (bool)spec;
+		std::shared_ptr<SweepState> state;
+		if(ok && !sweepstate.empty()) {
+			state.reset(new SweepState(sweepstate));
+			ok = state->is_open();
+		}
+		// only rank 0 writes results; a resumable sweep adds to the results of its earlier attempts
+		std::shared_ptr<BatchOutput> output;
+		if(ok && mpi.is_root()) {
+			output.reset(new BatchOutput(batchoutput, (bool)state));
+			ok = output->is_open();
+		}
+		if(!mpi.all_ok(ok)) return 1;
+		long runs = run_sweep_mpi(*spec, output.get(), sweephistory, state.get(), checkpointinterval);
+		if(mpi.is_root()) {
+			CTModels::clog->info("Ran {} sweep replicates on {} ranks", runs, mpi.size());
+		}
+
+		timer.end("main");
+		print_event_timing();
+		return 0;
+	}
+
+	if(replicates > 0 || !batchfile.empty()) {
+		std::vector<RunParameters> configs;
+		if(!batchfile.empty()) {
+			if(!read_run_parameters(batchfile, configs)) return 1;
+		}
+		else {
+			RunParameters params;
+			params.popsize = popsize;
+			params.numloci = numloci;
+			params.inittraits = inittraits;
+			params.innovation_rate = innovrate;
+			params.rule = rt;
+			params.simlength = simlength;
+			configs.push_back(params);
+		}
+
+		BatchOutput output(batchoutput);
+		if(!output.is_open()) return 1;
+		int nreps = (replicates > 0) ? replicates : 1;
+		long runs = adaptive ? run_batch_adaptive(configs, nreps, output, (size_t)memorybudget << 20, calibrationgens)
+			: run_batch(configs, nreps, output);
+		CTModels::clog->info("Ran {} replicates of {} configurations", runs, configs.size());
+
+		timer.end("main");
+		print_event_timing();
+		return 0;
+	}
+
+	Population* pop;
+	if(restartfile.empty()) {
+		pop = new Population(popsize, numloci, inittraits, innovrate);
+		SPDLOG_TRACE(CTModels::clog, "Constructed population: {}", pop->dbg_params());
+		pop->initialize();
+	}
+	else {
+		ruletype checkpoint_rule;
+		pop = Population::from_checkpoint(restartfile, checkpoint_rule);
+		if(pop == nullptr) return 1;
+		if(checkpoint_rule != rt) {
+			CTModels::clog->error("checkpoint {} was written by a {} run and cannot continue as {}", restartfile, 
+				(checkpoint_rule == WFIA) ? "wfia" : "basicwf", (rt == WFIA) ? "wfia" : "basicwf");
+			delete pop;
+			return 1;
+		}
+		if(pop->get_popsize() != popsize || pop->get_numloci() != numloci || pop->get_inittraits() != inittraits || pop->get_innovation_rate() != innovrate) {
+			CTModels::clog->warn("population parameters on the command line are overridden by checkpoint {}", restartfile);
+		}
+		popsize = pop->get_popsize();
+		numloci = pop->get_numloci();
+		inittraits = pop->get_inittraits();
+		innovrate = pop->get_innovation_rate();
+		SPDLOG_DEBUG(CTModels::clog, "Restarted population at generation {}: {}", pop->get_generation(), pop->dbg_params());
+	}
+
+
+	std::shared_ptr<DynamicNetwork> dynamic_network;
+	if(networktype != "none") {
+		std::shared_ptr<SocialNetwork> network;
+		uint64_t network_seed = mt();
+		if(networktype == "lattice") {
+			// the most nearly square grid with popsize cells
+			int width = (int)std::sqrt((double)popsize);
+			while(popsize % width != 0) --width;
+			network = SocialNetwork::lattice(width, popsize / width);
+		}
+		else if(networktype == "random") {
+			network = SocialNetwork::erdos_renyi(popsize, networkdegree, network_seed);
+		}
+		else if(networktype == "smallworld") {
+			network = SocialNetwork::small_world(popsize, (int)networkdegree, rewiring, network_seed);
+		}
+		else if(networktype == "scalefree") {
+			network = SocialNetwork::scale_free(popsize, std::max(1, (int)(networkdegree / 2.0)), network_seed);
+		}
+		else {
+			network = SocialNetwork::from_edge_list(edgelist, popsize);
+		}
+		if(!network) return 1;
+		if(networklayout != "natural") {
+			std::vector<int> order = (networklayout == "rcm") ? network->rcm_order()
+				: (networklayout == "degree") ? network->degree_order() : network->hilbert_order();
+			if(order.empty()) {
+				CTModels::clog->error("the {} layout applies only to lattice networks", networklayout);
+				return 1;
+			}
+			network = network->permuted(order);
+		}
+		if(rewiringrate > 0.0) {
+			// rewired nodes get half their degree again in spare slots before they have to move
+			dynamic_network = std::make_shared<DynamicNetwork>(*network, 0.5);
+			if(!pop->set_network(dynamic_network)) return 1;
+		}
+		else if(!pop->set_network(network)) return 1;
+		SPDLOG_DEBUG(CTModels::clog, "Population on a {} network with {} edges", networktype, network->num_arcs / 2);
+	}
 
 	auto tf = pop->tabulate_trait_counts();
 	print_trait_counts(tf);
 
+	// the Space-Saving sketch monitors several times more traits than it reports, to keep its estimates tight
+	std::shared_ptr<TopTraits> initial_top;
+	if(topk > 0) {
+		initial_top = approxtopk ? pop->tabulate_top_traits(topk, 8 * topk) : calculate_top_traits(tf, topk);
+	}
+
+	std::shared_ptr<AssemblageAccumulator> accumulator;
+	if(windowlength > 0) {
+		accumulator.reset(new AssemblageAccumulator(numloci, windowlength, windowstep));
+		pop->set_accumulator(accumulator);
+	}
+
 	SPDLOG_DEBUG(CTModels::clog,"Evolving population for {} steps", simlength);
 
+	std::shared_ptr<TraitRegistry> registry;
+	if(!lifetimeoutput.empty() && lifetimeinterval <= 0) {
+		CTModels::clog->error("lifetimeoutput requires a lifetimeinterval above 0");
+		return 1;
+	}
+	if(lifetimeinterval > 0) {
+		registry.reset(new TraitRegistry(numloci));
+		pop->set_trait_registry(registry);
+	}
+
+	std::shared_ptr<TimeSeriesSampler> sampler;
+	if(sampleinterval > 0) {
+		std::shared_ptr<SampleSink> sink;
+		if(sampleformat == "columnar") {
+			ColumnarRunHeader header;
+			memset(&header, 0, sizeof(header));
+			header.numloci = numloci;
+			header.popsize = popsize;
+			header.inittraits = inittraits;
+			header.ruletype = rt;
+			header.innovation_rate = innovrate;
+			header.sample_interval = sampleinterval;
+			auto columnar = std::make_shared<ColumnarSampleSink>(sampleoutput, header, 256);
+			if(!columnar->is_open()) return 1;
+			sink = columnar;
+		}
+		else {
+			auto text = std::make_shared<TextSampleSink>(sampleoutput);
+			if(!text->is_open()) return 1;
+			sink = text;
+		}
+		sampler.reset(new TimeSeriesSampler(sink, sampleinterval, sampleindividuals, samplecounts, 1024));
+		sampler->sample_now(*pop);
+	}
+
+	std::shared_ptr<CheckpointWriter> checkpointer;
+	if(checkpointinterval > 0 && !checkpointfile.empty()) {
+		checkpointer.reset(new CheckpointWriter(checkpointfile));
+	}
+
+	// a key frame every 64 states bounds how far a reader has to decode to reach any state
+	std::shared_ptr<StateDumpWriter> dumper;
+	if(dumpinterval > 0) {
+		dumper.reset(new StateDumpWriter(dumpfile, popsize, numloci, 64, 4));
+		if(!dumper->is_open()) return 1;
+		pop->dump_state(*dumper);
+	}
+
+	// simlength is the total number of generations, so a restarted run only takes the remaining steps
 	switch(rt) {
 		case BASICWF :
-			for(int i = 0; i < simlength; i++)
+			while(pop->get_generation() < simlength) {
 				pop->step_basicwf();
+				if(dynamic_network) {
+					dynamic_network->queue_random_rewiring(rewiringrate, mt());
+					dynamic_network->apply_updates();
+				}
+				if(registry && pop->get_generation() % lifetimeinterval == 0)
+					pop->tabulate_trait_counts();
+				if(sampler)
+					sampler->sample(*pop);
+				if(checkpointer && pop->get_generation() % checkpointinterval == 0)
+					pop->write_checkpoint(*checkpointer, rt);
+				if(dumper && pop->get_generation() % dumpinterval == 0)
+					pop->dump_state(*dumper);
+			}
 			break;
 		case WFIA :
-			for(int i = 0; i < simlength; i++) 
+			while(pop->get_generation() < simlength) {
 				pop->step_wfia();
+				if(dynamic_network) {
+					dynamic_network->queue_random_rewiring(rewiringrate, mt());
+					dynamic_network->apply_updates();
+				}
+				if(registry && pop->get_generation() % lifetimeinterval == 0)
+					pop->tabulate_trait_counts();
+				if(sampler)
+					sampler->sample(*pop);
+				if(checkpointer && pop->get_generation() % checkpointinterval == 0)
+					pop->write_checkpoint(*checkpointer, rt);
+				if(dumper && pop->get_generation() % dumpinterval == 0)
+					pop->dump_state(*dumper);
+			}
 			break;
 	}
 
+	if(sampler) {
+		sampler->finish();
+	}
+	if(dumper) {
+		dumper->finish();
+	}
+	if(checkpointer && !checkpointer->wait()) {
+		return 1;
+	}
+
 
 	auto tf2 = pop->tabulate_trait_counts();
 	auto ts = calculate_trait_statistics(tf2);
+	auto tt = diff_trait_occupancy(tf, tf2);
+	if(neutralityreps > 0) {
+		ts->neutrality_tests = calculate_neutrality_tests(tf2, neutralityreps);
+	}
 
 	print_trait_statistics(ts);
+	if(ts->neutrality_tests) {
+		print_neutrality_tests(ts->neutrality_tests);
+	}
+	print_trait_turnover(tt);
 	print_trait_counts(tf2);
 
+	if(!classificationfiles.empty()) {
+		std::vector<std::shared_ptr<Classification>> classifications;
+		for(auto it = classificationfiles.begin(); it != classificationfiles.end(); ++it) {
+			auto cls = Classification::from_file(*it, numloci);
+			if(!cls) return 1;
+			classifications.push_back(cls);
+		}
+		auto class_freqs = pop->tabulate_classes(classifications);
+		for(size_t i = 0; i < class_freqs.size(); i++) {
+			SPDLOG_DEBUG(CTModels::clog, "Class frequencies for classification {}", classificationfiles[i]);
+			print_class_frequencies(class_freqs[i]);
+		}
+	}
+
+	if(associationsample != 0) {
+		auto compacted = pop->compact_traits((associationsample > 0) ? associationsample : 0, withreplacement);
+		print_locus_associations(calculate_locus_associations(compacted));
+	}
+
+	if(configurations == 1) {
+		print_configuration_frequencies(pop->tabulate_configurations(), popsize);
+	}
+	else if(configurations == 2) {
+		SPDLOG_DEBUG(CTModels::clog, "estimated distinct configurations: {}", pop->estimate_num_configurations(14));
+	}
+
+	if(topk > 0) {
+		auto final_top = approxtopk ? pop->tabulate_top_traits(topk, 8 * topk) : calculate_top_traits(tf2, topk);
+		print_top_traits(final_top);
+		auto turnover = calculate_top_turnover(initial_top, final_top);
+		for(int locus = 0; locus < numloci; locus++) {
+			SPDLOG_DEBUG(CTModels::clog, "top {} turnover @ locus: {}: {}", topk, locus, turnover[locus]);
+		}
+	}
+
+	if(registry) {
+		print_trait_lifetimes(registry, pop->get_generation(), popsize);
+		if(!lifetimeoutput.empty() && !write_trait_lifetimes(registry, pop->get_generation(), popsize, lifetimeoutput)) {
+			return 1;
+		}
+	}
+
+	if(accumulator) {
+		auto windows = accumulator->take_completed_windows();
+		for(auto it = windows.begin(); it != windows.end(); ++it) {
+			SPDLOG_DEBUG(CTModels::clog, "Statistics for assemblage window starting at generation {} spanning {} generations", 
+				(*it)->start_generation, (*it)->num_generations);
+			print_trait_statistics(calculate_trait_statistics((*it)->to_trait_frequencies()));
+		}
+	}
+
+	if(!samplesizes.empty()) {
+		auto samples = pop->tabulate_sample_trait_counts(samplesizes, withreplacement);
+		for(size_t i = 0; i < samples.size(); i++) {
+			SPDLOG_DEBUG(CTModels::clog, "Statistics for sample of {} individuals", samplesizes[i]);
+			auto sample_ts = calculate_trait_statistics(samples[i]);
+			if(neutralityreps > 0) {
+				sample_ts->neutrality_tests = calculate_neutrality_tests(samples[i], neutralityreps);
+			}
+			print_trait_statistics(sample_ts);
+			if(sample_ts->neutrality_tests) {
+				print_neutrality_tests(sample_ts->neutrality_tests);
+			}
+		}
+	}
+
 	timer.end("main");
 
 	print_event_timing();
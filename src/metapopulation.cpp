@@ -0,0 +1,260 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <string.h>
+#include <spdlog/spdlog.h>
+
+#include "metapopulation.h"
+#include "network.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+namespace spd = spdlog;
+
+
+
+namespace CTModels {
+
+// separates the hashes choosing migrants from those drawing immigrant counts
+static const uint64_t MIGRATION_SALT = 0x2545f4914f6cdd1dULL;
+
+
+// a random engine over the counter-based hash, so a <random> distribution can be drawn for one deme without
+// the cost of seeding a Mersenne Twister
+struct HashEngine {
+	typedef uint64_t result_type;
+	uint64_t seed;
+	uint64_t counter;
+
+	HashEngine(uint64_t s, uint64_t c) : seed(s), counter(c << 32) {}
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~(result_type)0; }
+	result_type operator()() { return hash_random(seed, counter++); }
+};
+
+
+Metapopulation::Metapopulation(int d, int s, int n, int i, double r, double m)
+	: numdemes(d), deme_size(s), numloci(n), inittraits(i), innovation_rate(r), migration_rate(m) {
+	popsize = numdemes * deme_size;
+	size_t bufsize = (size_t)popsize * numloci * sizeof(int);
+	population_traits = (int*) ALIGNED_MALLOC(bufsize);
+	prev_population_traits = (int*) ALIGNED_MALLOC(bufsize);
+	immigrant_offsets.resize(numdemes + 1);
+}
+
+
+Metapopulation::~Metapopulation() {
+	FREE(population_traits);
+	FREE(prev_population_traits);
+}
+
+
+void Metapopulation::initialize() {
+	timer.start("metapopulation::initialize");
+	if(seeded) {
+		this->mt.seed(seed_value);
+	}
+	else {
+		std::random_device rd_mt;
+		this->mt.seed(rd_mt());
+	}
+
+	std::poisson_distribution<int> p{static_cast<double>(popsize) * innovation_rate};
+	poisson_dist = p;
+	std::uniform_int_distribution<int> u{0, popsize - 1};
+	uniform_pop = u;
+	std::uniform_int_distribution<int> l{0, numloci - 1};
+	uniform_locus = l;
+	next_trait.assign(numloci, inittraits + 1);
+	generation = 0;
+
+	uint64_t seed = mt();
+	int64_t cells = (int64_t)popsize * numloci;
+	#pragma omp parallel for simd schedule(static)
+	for(int64_t i = 0; i < cells; i++) {
+		population_traits[i] = random_below(hash_random(seed, i), inittraits);
+	}
+	memcpy(prev_population_traits, population_traits, cells * sizeof(int));
+	timer.end("metapopulation::initialize");
+}
+
+
+void Metapopulation::step_copy() {
+	std::swap(population_traits, prev_population_traits);
+	++generation;
+
+	timer.start("metapopulation::step_copy");
+	uint64_t seed = mt();
+	#pragma omp parallel for schedule(static)
+	for(int indiv = 0; indiv < popsize; indiv++) {
+		int deme_first = indiv - indiv % deme_size;
+		int parent = deme_first + random_below(hash_random(seed, indiv), deme_size);
+		for(int locus = 0; locus < numloci; locus++) {
+			population_traits[(size_t)indiv * numloci + locus] = prev_population_traits[(size_t)parent * numloci + locus];
+		}
+	}
+	timer.end("metapopulation::step_copy");
+}
+
+
+void Metapopulation::migrate() {
+	if(migration_rate <= 0.0 || numdemes < 2) return;
+	timer.start("metapopulation::migrate");
+	uint64_t seed = mt();
+
+	// immigrants of deme d will occupy slots [immigrant_offsets[d], immigrant_offsets[d + 1]) of the buffer
+	#pragma omp parallel for schedule(static)
+	for(int deme = 0; deme < numdemes; deme++) {
+		HashEngine engine(seed, deme);
+		std::binomial_distribution<int> immigrants(deme_size, migration_rate);
+		immigrant_offsets[deme + 1] = immigrants(engine);
+	}
+	immigrant_offsets[0] = 0;
+	for(int deme = 0; deme < numdemes; deme++) {
+		immigrant_offsets[deme + 1] += immigrant_offsets[deme];
+	}
+	int total = immigrant_offsets[numdemes];
+	migrant_rows.resize((size_t)total * numloci);
+
+	// gather every migrant before any deme is overwritten, copying a random member of a random other deme
+	#pragma omp parallel for schedule(dynamic, 64)
+	for(int deme = 0; deme < numdemes; deme++) {
+		for(int slot = immigrant_offsets[deme]; slot < immigrant_offsets[deme + 1]; slot++) {
+			uint64_t r = hash_random(seed ^ MIGRATION_SALT, slot);
+			int source = random_below(r, numdemes - 1);
+			if(source >= deme) ++source;
+			int member = random_below(r << 32, deme_size);
+			const int* row = population_traits + ((size_t)source * deme_size + member) * numloci;
+			std::copy(row, row + numloci, migrant_rows.data() + (size_t)slot * numloci);
+		}
+	}
+
+	#pragma omp parallel for schedule(static)
+	for(int deme = 0; deme < numdemes; deme++) {
+		size_t first = (size_t)immigrant_offsets[deme] * numloci;
+		size_t last = (size_t)immigrant_offsets[deme + 1] * numloci;
+		std::copy(migrant_rows.data() + first, migrant_rows.data() + last, population_traits + (size_t)deme * deme_size * numloci);
+	}
+	SPDLOG_TRACE(clog, "migrated {} individuals", total);
+	timer.end("metapopulation::migrate");
+}
+
+
+void Metapopulation::step_basicwf() {
+	step_copy();
+	migrate();
+}
+
+
+void Metapopulation::step_wfia() {
+	step_copy();
+	migrate();
+
+	int num_mutations = poisson_dist(this->mt);
+	for(int j = 0; j < num_mutations; j++) {
+		int indiv = uniform_pop(this->mt);
+		int locus = uniform_locus(this->mt);
+		population_traits[(size_t)indiv * numloci + locus] = next_trait[locus]++;
+	}
+}
+
+
+std::shared_ptr<TraitFrequencies> Metapopulation::tabulate_trait_counts(DemeStatistics* demes) {
+	timer.start("metapopulation::tabulate_trait_counts");
+
+	// each thread counts its demes sparsely, so the cost follows the population and the traits present in it
+	// rather than every trait ever introduced
+	std::vector<std::vector<TraitCounter>> thread_counts;
+
+#pragma omp parallel
+{
+	#pragma omp single
+	thread_counts.resize(NUM_THREADS(), std::vector<TraitCounter>(numloci));
+	TraitCounter* counts = thread_counts[THREAD_NUM()].data();
+
+	// a deme is counted on its own first when its statistics are wanted, then folded into the thread's counts
+	TraitCounter deme_counts;
+
+	#pragma omp for schedule(static)
+	for(int deme = 0; deme < numdemes; deme++) {
+		const int* rows = population_traits + (size_t)deme * deme_size * numloci;
+		for(int locus = 0; locus < numloci; locus++) {
+			if(!demes) {
+				for(int member = 0; member < deme_size; member++) {
+					counts[locus].add(rows[member * numloci + locus], 1);
+				}
+				continue;
+			}
+
+			deme_counts.clear();
+			for(int member = 0; member < deme_size; member++) {
+				deme_counts.add(rows[member * numloci + locus], 1);
+			}
+			int richness = 0;
+			double concentration = 0.0;
+			deme_counts.for_each([&](int trait, int64_t n) {
+				double freq = (double)n / deme_size;
+				concentration += freq * freq;
+				++richness;
+			});
+			counts[locus].merge(deme_counts);
+
+			int stamp = deme * numloci + locus;
+			demes->deme_richness[stamp] = richness;
+			demes->deme_diversity[stamp] = 1.0 - concentration;
+		}
+	}
+
+	#pragma omp for schedule(dynamic)
+	for(int locus = 0; locus < numloci; locus++) {
+		for(size_t t = 1; t < thread_counts.size(); t++) {
+			thread_counts[0][locus].merge(thread_counts[t][locus]);
+		}
+	}
+}
+	std::shared_ptr<TraitFrequencies> tf = compact_trait_frequencies(thread_counts[0]);
+
+	if(demes) {
+		for(int locus = 0; locus < numloci; locus++) {
+			double richness = 0.0;
+			double within = 0.0;
+			for(int deme = 0; deme < numdemes; deme++) {
+				richness += demes->deme_richness[deme * numloci + locus];
+				within += demes->deme_diversity[deme * numloci + locus];
+			}
+			// the Simpson concentration, over the traits present
+			double concentration = 0.0;
+			const int* locus_counts = tf->trait_counts + (size_t)locus * tf->max_num_traits;
+			for(int column = 0; column < tf->max_num_traits; column++) {
+				double freq = (double)locus_counts[column] / popsize;
+				concentration += freq * freq;
+			}
+			demes->mean_richness[locus] = richness / numdemes;
+			demes->within_diversity[locus] = within / numdemes;
+			demes->total_diversity[locus] = 1.0 - concentration;
+			demes->fst[locus] = (concentration < 1.0) ? (demes->total_diversity[locus] - demes->within_diversity[locus]) / demes->total_diversity[locus] : 0.0;
+		}
+	}
+	timer.end("metapopulation::tabulate_trait_counts");
+	return tf;
+}
+
+
+void print_deme_statistics(const DemeStatistics& ds) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+		for(int locus = 0; locus < ds.numloci; locus++) {
+			std::stringstream s;
+			s << "demes @ locus: " << locus << ": mean richness: " << std::fixed << std::setprecision(4) << ds.mean_richness[locus];
+			s << " H_S: " << ds.within_diversity[locus];
+			s << " H_T: " << ds.total_diversity[locus];
+			s << " F_ST: " << ds.fst[locus];
+			SPDLOG_DEBUG(clog, "{}", s.str());
+		}
+	}
+}
+
+
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "defines.h"
+#include "statistics.h"
+
+
+namespace CTModels {
+
+/** \class DemeStatistics
+*
+* Diversity within and among the demes of a metapopulation, per locus:  the richness and Simpson diversity
+* (1 - sum of squared trait frequencies) of every deme, addressed as [deme * numloci + locus], and for each 
+* locus the mean within-deme richness, the mean within-deme diversity H_S, the diversity of the pooled 
+* metapopulation H_T, and the differentiation among demes F_ST = (H_T - H_S) / H_T.  
+*/
+
+class DemeStatistics {
+public:
+	int numdemes;
+	int numloci;
+	std::vector<int> deme_richness;
+	std::vector<double> deme_diversity;
+	std::vector<double> mean_richness;
+	std::vector<double> within_diversity;
+	std::vector<double> total_diversity;
+	std::vector<double> fst;
+
+	DemeStatistics(int d, int n) : numdemes(d), numloci(n), deme_richness(d * n), deme_diversity(d * n),
+		mean_richness(n), within_diversity(n), total_diversity(n), fst(n) {}
+};
+
+
+/** \class Metapopulation
+*
+* An island model metapopulation:  numdemes demes of deme_size individuals, in which each generation every
+* deme is replaced by Wright-Fisher copying among its own members, and then receives a Binomial(deme_size, m) 
+* number of immigrants copied from uniformly chosen other demes, replacing residents.  
+*
+* All demes live in one contiguous trait array, deme d holding rows [d * deme_size, (d + 1) * deme_size), so 
+* the within-deme step is a single vectorized, parallel loop over every individual with no per-deme setup.  
+* Migration is batched:  immigrant counts are drawn for every deme at once, the migrant rows are gathered into
+* one buffer laid out by destination deme, and each deme then copies its block of immigrants over its first 
+* rows (offspring are exchangeable, so these are a random choice of residents).  Random draws are counter-based
+* hashes of the step seed and the individual, deme or migrant, so results do not depend on the number of threads.
+*/
+
+class Metapopulation {
+private:
+	int numdemes;
+	int deme_size;
+	int numloci;
+	int inittraits;
+	double innovation_rate;
+	double migration_rate;
+	int popsize;
+	int generation = 0;
+	bool seeded = false;
+	uint64_t seed_value = 0;
+
+	std::mt19937_64 mt;
+	std::poisson_distribution<int> poisson_dist;
+	std::uniform_int_distribution<int> uniform_pop;
+	std::uniform_int_distribution<int> uniform_locus;
+	std::vector<int> next_trait;
+	int* population_traits = nullptr;
+	int* prev_population_traits = nullptr;
+
+	std::vector<int> immigrant_offsets;
+	std::vector<int> migrant_rows;
+
+	void step_copy();
+	void migrate();
+
+public:
+	Metapopulation(int d, int s, int n, int i, double r, double m);
+	~Metapopulation();
+
+	/** Sets up every deme with uniform random initial traits, as Population::initialize() does. */
+	void initialize();
+
+	/** Seeds the random number engines for the next initialize(). */
+	void set_seed(uint64_t seed) { seeded = true; seed_value = seed; }
+
+	/** One generation of within-deme copying without innovation, followed by migration. */
+	void step_basicwf();
+
+	/** One generation of within-deme copying with infinite-alleles innovation, followed by migration. */
+	void step_wfia();
+
+	/**
+	* Tabulates trait counts over the whole metapopulation, one deme at a time in parallel, into sparse per-thread
+	* counters merged into compact columns.  If demes is given, the within-deme and among-deme statistics are 
+	* filled in during the same pass.  
+	*/
+	std::shared_ptr<TraitFrequencies> tabulate_trait_counts(DemeStatistics* demes = nullptr);
+
+	int get_generation() { return generation; }
+	int get_popsize() { return popsize; }
+};
+
+
+void print_deme_statistics(const DemeStatistics& ds);
+
+};
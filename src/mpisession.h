@@ -0,0 +1,58 @@
+#pragma once
+
+#if defined(USE_MPI)
+#include <mpi.h>
+#endif
+
+
+namespace CTModels {
+
+/** \class MpiSession
+*
+* Initializes MPI for the lifetime of the object and finalizes it on destruction, so every return from 
+* main() shuts MPI down.  MPI calls are only made from the thread that owns the session (funneled), while
+* OpenMP threads run the kernels.  Built without USE_MPI, the session is a single rank.  
+*/
+
+class MpiSession {
+private:
+	int rank_;
+	int size_;
+
+public:
+	MpiSession(int* argc, char*** argv) : rank_(0), size_(1) {
+#if defined(USE_MPI)
+		int provided;
+		MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
+		MPI_Comm_size(MPI_COMM_WORLD, &size_);
+#endif
+	}
+
+	~MpiSession() {
+#if defined(USE_MPI)
+		MPI_Finalize();
+#endif
+	}
+
+	int rank() { return rank_; }
+	int size() { return size_; }
+	bool is_root() { return rank_ == 0; }
+
+	/**
+	* Returns true on every rank if ok is true on every rank.  Collective:  all ranks must call it, so a
+	* setup failure on one rank makes all of them return instead of leaving the others blocked in a send.
+	*/
+	bool all_ok(bool ok) {
+#if defined(USE_MPI)
+		int local = ok ? 1 : 0;
+		int global;
+		MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+		return global != 0;
+#else
+		return ok;
+#endif
+	}
+};
+
+};
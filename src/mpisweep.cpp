@@ -0,0 +1,200 @@
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <spdlog/spdlog.h>
+
+#include "mpisweep.h"
+#include "mpisession.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+#if defined(USE_MPI)
+
+static const int TAG_REQUEST = 1;
+static const int TAG_JOB = 2;
+
+// values per locus in a returned result:  richness, entropy, simpson, evenness, dominant frequency
+static const int STATS_PER_LOCUS = 5;
+
+/*
+* A job as sent from rank 0 to a worker; job is -1 to tell the worker to stop.  Sent as bytes, since all
+* ranks run the same binary.
+*/
+struct MpiJobMessage {
+	int32_t job;
+	int32_t config_index;
+	int32_t replicate;
+	int32_t popsize;
+	int32_t numloci;
+	int32_t inittraits;
+	int32_t rule;
+	int32_t simlength;
+	double innovation_rate;
+	uint64_t seed;
+};
+
+
+/*
+* A worker's request for work, carrying the result of its previous job:  job (-1 for none), elapsed
+* seconds, whether the job was resumed, numloci, then STATS_PER_LOCUS values for each locus.
+*/
+static void pack_result(int job, const ReplicateResult& result, bool resumed, std::vector<double>& msg) {
+	const TraitStatistics& ts = *result.stats;
+	msg.assign(4, 0.0);
+	msg[0] = job;
+	msg[1] = result.elapsed;
+	msg[2] = resumed ? 1.0 : 0.0;
+	msg[3] = ts.numloci;
+	for(int locus = 0; locus < ts.numloci; locus++) {
+		msg.push_back(ts.trait_richness_by_locus[locus]);
+		msg.push_back(ts.shannon_entropy_by_locus[locus]);
+		msg.push_back(ts.simpson_diversity_by_locus[locus]);
+		msg.push_back(ts.evenness_by_locus[locus]);
+		msg.push_back(ts.dominant_freq_by_locus[locus]);
+	}
+}
+
+
+static ReplicateResult unpack_result(const std::vector<double>& msg, const SweepJob& job) {
+	ReplicateResult result;
+	result.config_index = job.config_index;
+	result.replicate = job.replicate;
+	result.elapsed = msg[1];
+	int numloci = (int)msg[3];
+	result.stats.reset(new TraitStatistics(numloci));
+	for(int locus = 0; locus < numloci; locus++) {
+		const double* v = &msg[4 + locus * STATS_PER_LOCUS];
+		result.stats->trait_richness_by_locus[locus] = (int)v[0];
+		result.stats->shannon_entropy_by_locus[locus] = v[1];
+		result.stats->simpson_diversity_by_locus[locus] = v[2];
+		result.stats->evenness_by_locus[locus] = v[3];
+		result.stats->dominant_freq_by_locus[locus] = v[4];
+	}
+	return result;
+}
+
+
+static long serve_sweep_jobs(SweepSpec& spec, BatchOutput& output, const std::string& history_path, SweepState* state, int num_workers) {
+	SweepCostModel model;
+	if(!history_path.empty()) {
+		model.load_history(history_path);
+	}
+	std::vector<double> expected;
+	std::vector<SweepJob> jobs = prepare_sweep_jobs(spec, state, model, expected);
+	std::vector<double> elapsed(jobs.size(), -1.0);
+	SPDLOG_DEBUG(clog, "mpi sweep: {} jobs for {} worker ranks", jobs.size(), num_workers);
+
+	long runs = 0;
+	size_t next = 0;
+	int stopped = 0;
+	std::vector<double> msg;
+	while(stopped < num_workers) {
+		MPI_Status status;
+		int count;
+		MPI_Probe(MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &status);
+		MPI_Get_count(&status, MPI_DOUBLE, &count);
+		msg.resize(count);
+		MPI_Recv(msg.data(), count, MPI_DOUBLE, status.MPI_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+		int done = (int)msg[0];
+		if(done >= 0) {
+			const SweepJob& job = jobs[done];
+			output.write(job.params, unpack_result(msg, job));
+			if(state != nullptr) {
+				output.flush();
+				state->mark_complete(job);
+			}
+			if(msg[2] == 0.0) elapsed[done] = msg[1];
+			++runs;
+		}
+
+		MpiJobMessage jm;
+		memset(&jm, 0, sizeof(jm));
+		jm.job = -1;
+		if(next < jobs.size()) {
+			const SweepJob& job = jobs[next];
+			jm.job = next;
+			jm.config_index = job.config_index;
+			jm.replicate = job.replicate;
+			jm.popsize = job.params.popsize;
+			jm.numloci = job.params.numloci;
+			jm.inittraits = job.params.inittraits;
+			jm.rule = job.params.rule;
+			jm.simlength = job.params.simlength;
+			jm.innovation_rate = job.params.innovation_rate;
+			jm.seed = job.seed;
+			++next;
+		}
+		else {
+			++stopped;
+		}
+		MPI_Send(&jm, sizeof(jm), MPI_BYTE, status.MPI_SOURCE, TAG_JOB, MPI_COMM_WORLD);
+	}
+
+	output.flush();
+	if(!history_path.empty()) {
+		append_sweep_history(history_path, jobs, elapsed);
+	}
+	return runs;
+}
+
+
+static void work_sweep_jobs(SweepState* state, int checkpoint_interval) {
+	Population pop(1, 1, 1, 0.0);
+	std::vector<double> msg(1, -1.0);
+	while(true) {
+		MPI_Send(msg.data(), msg.size(), MPI_DOUBLE, 0, TAG_REQUEST, MPI_COMM_WORLD);
+		MpiJobMessage jm;
+		MPI_Recv(&jm, sizeof(jm), MPI_BYTE, 0, TAG_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		if(jm.job < 0) break;
+
+		SweepJob job;
+		job.config_index = jm.config_index;
+		job.replicate = jm.replicate;
+		job.params.popsize = jm.popsize;
+		job.params.numloci = jm.numloci;
+		job.params.inittraits = jm.inittraits;
+		job.params.rule = (ruletype)jm.rule;
+		job.params.simlength = jm.simlength;
+		job.params.innovation_rate = jm.innovation_rate;
+		job.seed = jm.seed;
+		job.key = sweep_job_key(job.params, job.seed);
+
+		bool resumed;
+		ReplicateResult result = run_sweep_job(pop, job, state, checkpoint_interval, nullptr, resumed);
+		pack_result(jm.job, result, resumed, msg);
+	}
+}
+
+#endif
+
+
+long run_sweep_mpi(SweepSpec& spec, BatchOutput* output, const std::string& history_path, SweepState* state, int checkpoint_interval) {
+#if defined(USE_MPI)
+	int rank, size;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+	if(size > 1) {
+		timer.start("mpisweep::run_sweep_mpi");
+		long runs = 0;
+		if(rank == 0) {
+			runs = serve_sweep_jobs(spec, *output, history_path, state, size - 1);
+		}
+		else {
+			work_sweep_jobs(state, checkpoint_interval);
+		}
+		timer.end("mpisweep::run_sweep_mpi");
+		return runs;
+	}
+#endif
+	return run_sweep(spec, *output, history_path, state, checkpoint_interval);
+}
+
+
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include "defines.h"
+#include "batch.h"
+#include "sweep.h"
+
+
+namespace CTModels {
+
+/**
+* Runs a sweep across all MPI ranks with a master/worker protocol.  Rank 0 prepares the jobs exactly as 
+* run_sweep() does (manifest, index, longest expected first) and hands them out one at a time:  each worker
+* asks for a job, runs it with all of its OpenMP threads inside the steps, and returns the result with its
+* next request, so faster ranks simply take more jobs and the longest jobs start first.  Rank 0 writes every
+* result to output in the usual format and updates the state's index and the timing history.  Checkpoints 
+* are written by the worker running the job, into the state directory, which must be shared by all ranks.
+*
+* Rank 0 only hands out jobs and collects results; it runs no simulations itself.  With one rank per node,
+* launch one more rank than the number of nodes meant to compute (e.g. place rank 0 on a node alongside a
+* worker) so that no node sits idle.  Setup errors must be resolved collectively before calling this (see
+* MpiSession::all_ok()), since a rank that never enters leaves the others waiting.
+*
+* Only rank 0 needs output; other ranks may pass nullptr.  With a single rank, this is run_sweep().  Returns
+* the number of replicates run (on rank 0; 0 elsewhere).  Without USE_MPI, always calls run_sweep().
+*/
+long run_sweep_mpi(SweepSpec& spec, BatchOutput* output, const std::string& history_path, SweepState* state, int checkpoint_interval);
+
+};
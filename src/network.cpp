@@ -0,0 +1,609 @@
+#include <iostream>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <spdlog/spdlog.h>
+
+#include "network.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+// maps a random 64-bit value onto [0, range) for ranges too large for random_below()
+static inline uint64_t random_below_64(uint64_t r, uint64_t range) {
+	return (uint64_t)(((unsigned __int128)r * range) >> 64);
+}
+
+// a random double in [0, 1)
+static inline double random_unit(uint64_t r) {
+	return (r >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+SocialNetwork::SocialNetwork(int n, int64_t arcs) : Network(n), num_arcs(arcs) {
+	offsets = (int64_t*) ALIGNED_MALLOC((n + 1) * sizeof(int64_t));
+	neighbors = (int*) ALIGNED_MALLOC(std::max(arcs, (int64_t)1) * sizeof(int));
+}
+
+
+SocialNetwork::~SocialNetwork() {
+	FREE(offsets);
+	FREE(neighbors);
+}
+
+
+void SocialNetwork::sample_neighbors(int* parents, uint64_t seed) const {
+	timer.start("SocialNetwork::sample_neighbors");
+	const int64_t* off = offsets;
+	const int* nbr = neighbors;
+	int n = num_nodes;
+
+	#pragma omp parallel for simd schedule(static)
+	for(int v = 0; v < n; v++) {
+		int64_t begin = off[v];
+		uint32_t deg = (uint32_t)(off[v + 1] - begin);
+		uint32_t pick = random_below(hash_random(seed, v), deg);
+		parents[v] = (deg > 0) ? nbr[begin + pick] : v;
+	}
+	timer.end("SocialNetwork::sample_neighbors");
+}
+
+
+std::shared_ptr<SocialNetwork> SocialNetwork::from_edges(int n, const std::vector<int>& src, const std::vector<int>& dst) {
+	timer.start("SocialNetwork::from_edges");
+	int64_t num_edges = (int64_t)src.size();
+
+	// count both directions of every edge, then scatter arcs into place with an atomic cursor per node 
+	std::vector<int64_t> counts(n + 1, 0);
+	#pragma omp parallel for schedule(static)
+	for(int64_t e = 0; e < num_edges; e++) {
+		if(src[e] == dst[e]) continue;
+		#pragma omp atomic
+		++counts[src[e]];
+		#pragma omp atomic
+		++counts[dst[e]];
+	}
+
+	std::vector<int64_t> cursor(n + 1);
+	int64_t total = 0;
+	for(int v = 0; v < n; v++) {
+		cursor[v] = total;
+		total += counts[v];
+	}
+	cursor[n] = total;
+	std::vector<int64_t> raw_offsets(cursor);
+	std::vector<int> raw(std::max(total, (int64_t)1));
+
+	#pragma omp parallel for schedule(static)
+	for(int64_t e = 0; e < num_edges; e++) {
+		int a = src[e];
+		int b = dst[e];
+		if(a == b) continue;
+		int64_t pa, pb;
+		#pragma omp atomic capture
+		pa = cursor[a]++;
+		#pragma omp atomic capture
+		pb = cursor[b]++;
+		raw[pa] = b;
+		raw[pb] = a;
+	}
+
+	// sort each adjacency list and drop repeated edges, then compact into the final arrays
+	#pragma omp parallel for schedule(dynamic, 1024)
+	for(int v = 0; v < n; v++) {
+		int* begin = raw.data() + raw_offsets[v];
+		int* end = raw.data() + raw_offsets[v + 1];
+		std::sort(begin, end);
+		counts[v] = std::unique(begin, end) - begin;
+	}
+
+	int64_t arcs = 0;
+	for(int v = 0; v < n; v++) arcs += counts[v];
+	std::shared_ptr<SocialNetwork> g = std::make_shared<SocialNetwork>(n, arcs);
+	g->offsets[0] = 0;
+	for(int v = 0; v < n; v++) g->offsets[v + 1] = g->offsets[v] + counts[v];
+
+	#pragma omp parallel for schedule(static)
+	for(int v = 0; v < n; v++) {
+		std::copy(raw.data() + raw_offsets[v], raw.data() + raw_offsets[v] + counts[v], g->neighbors + g->offsets[v]);
+	}
+
+	SPDLOG_DEBUG(clog, "network with {} nodes and {} edges ({} given)", n, arcs / 2, num_edges);
+	timer.end("SocialNetwork::from_edges");
+	return g;
+}
+
+
+std::shared_ptr<SocialNetwork> SocialNetwork::from_edge_list(const std::string& path, int num_nodes) {
+	FILE* in = fopen(path.c_str(), "r");
+	if(in == NULL) {
+		clog->error("cannot read edge list {}", path);
+		return std::shared_ptr<SocialNetwork>();
+	}
+
+	std::vector<int> src, dst;
+	char line[256];
+	int line_num = 0;
+	long max_id = -1;
+	while(fgets(line, sizeof(line), in) != NULL) {
+		++line_num;
+		char* p = line;
+		while(*p == ' ' || *p == '\t') ++p;
+		if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+		char* end;
+		long a = strtol(p, &end, 10);
+		char* end2;
+		long b = strtol(end, &end2, 10);
+		if(end == p || end2 == end || a < 0 || b < 0 || a > 0x7fffffff || b > 0x7fffffff) {
+			clog->error("{}:{}: malformed edge", path, line_num);
+			fclose(in);
+			return std::shared_ptr<SocialNetwork>();
+		}
+		src.push_back((int)a);
+		dst.push_back((int)b);
+		max_id = std::max(max_id, std::max(a, b));
+	}
+	fclose(in);
+
+	if(num_nodes == 0) num_nodes = (int)(max_id + 1);
+	if(max_id >= num_nodes) {
+		clog->error("edge list {} names node {}, but the network has {} nodes", path, max_id, num_nodes);
+		return std::shared_ptr<SocialNetwork>();
+	}
+	return from_edges(num_nodes, src, dst);
+}
+
+
+std::shared_ptr<SocialNetwork> SocialNetwork::lattice(int width, int height) {
+	int n = width * height;
+	std::vector<int> src(2 * (size_t)n), dst(2 * (size_t)n);
+
+	// each node contributes its edges to the right and below, wrapping at the borders
+	#pragma omp parallel for schedule(static)
+	for(int v = 0; v < n; v++) {
+		int x = v % width;
+		int y = v / width;
+		src[2 * (size_t)v] = v;
+		dst[2 * (size_t)v] = y * width + (x + 1) % width;
+		src[2 * (size_t)v + 1] = v;
+		dst[2 * (size_t)v + 1] = ((y + 1) % height) * width + x;
+	}
+	std::shared_ptr<SocialNetwork> g = from_edges(n, src, dst);
+	g->lattice_width = width;
+	g->lattice_height = height;
+	return g;
+}
+
+
+std::shared_ptr<SocialNetwork> SocialNetwork::erdos_renyi(int n, double mean_degree, uint64_t seed) {
+	int64_t m = (int64_t)(n * mean_degree / 2.0 + 0.5);
+	std::vector<int> src(m), dst(m);
+
+	#pragma omp parallel for schedule(static)
+	for(int64_t e = 0; e < m; e++) {
+		src[e] = (int)random_below(hash_random(seed, 2 * e), n);
+		dst[e] = (int)random_below(hash_random(seed, 2 * e + 1), n);
+	}
+	return from_edges(n, src, dst);
+}
+
+
+std::shared_ptr<SocialNetwork> SocialNetwork::small_world(int n, int k, double beta, uint64_t seed) {
+	int half = k / 2;
+	int64_t m = (int64_t)n * half;
+	std::vector<int> src(m), dst(m);
+
+	#pragma omp parallel for schedule(static)
+	for(int v = 0; v < n; v++) {
+		for(int j = 1; j <= half; j++) {
+			int64_t e = (int64_t)v * half + (j - 1);
+			src[e] = v;
+			if(random_unit(hash_random(seed, 2 * e)) < beta) {
+				dst[e] = (int)random_below(hash_random(seed, 2 * e + 1), n);
+			}
+			else {
+				dst[e] = (v + j) % n;
+			}
+		}
+	}
+	return from_edges(n, src, dst);
+}
+
+
+std::shared_ptr<SocialNetwork> SocialNetwork::scale_free(int n, int m, uint64_t seed) {
+	// the first m + 1 nodes form a clique, after which node v brings edges (v, *) numbered from
+	// core_edges + (v - core) * m.  Endpoint slot 2e is the source of edge e, slot 2e + 1 its target.
+	int core = std::min(n, m + 1);
+	int64_t core_edges = (int64_t)core * (core - 1) / 2;
+	int64_t num_edges = core_edges + (int64_t)(n - core) * m;
+	std::vector<int> src(num_edges), dst(num_edges);
+
+	int64_t e = 0;
+	for(int a = 0; a < core; a++) {
+		for(int b = a + 1; b < core; b++, e++) {
+			src[e] = a;
+			dst[e] = b;
+		}
+	}
+
+	#pragma omp parallel for schedule(static)
+	for(int64_t e = core_edges; e < num_edges; e++) {
+		src[e] = core + (int)((e - core_edges) / m);
+	}
+
+	// the target of a new edge copies a uniformly chosen earlier endpoint slot; a copied target slot is 
+	// itself resolved the same way, down a chain of strictly earlier edges that ends at a source or a clique edge 
+	#pragma omp parallel for schedule(dynamic, 4096)
+	for(int64_t e = core_edges; e < num_edges; e++) {
+		int64_t edge = e;
+		int target = -1;
+		while(target < 0) {
+			uint64_t slot = random_below_64(hash_random(seed, edge), 2 * (uint64_t)edge);
+			int64_t from = (int64_t)(slot >> 1);
+			if(from < core_edges) {
+				target = (slot & 1) ? dst[from] : src[from];
+			}
+			else if((slot & 1) == 0) {
+				target = core + (int)((from - core_edges) / m);
+			}
+			else {
+				edge = from;
+			}
+		}
+		dst[e] = target;
+	}
+	return from_edges(n, src, dst);
+}
+
+
+std::shared_ptr<SocialNetwork> SocialNetwork::permuted(const std::vector<int>& order) const {
+	timer.start("SocialNetwork::permuted");
+	int n = num_nodes;
+	std::vector<int> inverse(n);
+	#pragma omp parallel for schedule(static)
+	for(int i = 0; i < n; i++) {
+		inverse[order[i]] = i;
+	}
+
+	std::shared_ptr<SocialNetwork> g = std::make_shared<SocialNetwork>(n, num_arcs);
+	g->offsets[0] = 0;
+	for(int i = 0; i < n; i++) g->offsets[i + 1] = g->offsets[i] + degree(order[i]);
+
+	g->external_ids.resize(n);
+	g->internal_ids.resize(n);
+	#pragma omp parallel for schedule(dynamic, 1024)
+	for(int i = 0; i < n; i++) {
+		int old = order[i];
+		int* out = g->neighbors + g->offsets[i];
+		int deg = degree(old);
+		for(int j = 0; j < deg; j++) {
+			out[j] = inverse[neighbors[offsets[old] + j]];
+		}
+		std::sort(out, out + deg);
+		g->external_ids[i] = to_external(old);
+	}
+
+	#pragma omp parallel for schedule(static)
+	for(int i = 0; i < n; i++) {
+		g->internal_ids[g->external_ids[i]] = i;
+	}
+
+	// a permuted lattice is no longer laid out in rows
+	g->lattice_width = 0;
+	g->lattice_height = 0;
+	timer.end("SocialNetwork::permuted");
+	return g;
+}
+
+
+std::vector<int> SocialNetwork::degree_order() const {
+	std::vector<int> order(num_nodes);
+	for(int v = 0; v < num_nodes; v++) order[v] = v;
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return degree(a) > degree(b); });
+	return order;
+}
+
+
+std::vector<int> SocialNetwork::rcm_order() const {
+	timer.start("SocialNetwork::rcm_order");
+	int n = num_nodes;
+
+	// components are started from their lowest degree unvisited node, found by scanning nodes by increasing degree
+	std::vector<int> by_degree = degree_order();
+	std::reverse(by_degree.begin(), by_degree.end());
+
+	std::vector<int> order;
+	order.reserve(n);
+	std::vector<char> visited(n, 0);
+	std::vector<int> frontier;
+	for(int start : by_degree) {
+		if(visited[start]) continue;
+		visited[start] = 1;
+		size_t head = order.size();
+		order.push_back(start);
+		while(head < order.size()) {
+			int v = order[head++];
+			frontier.clear();
+			for(int64_t j = offsets[v]; j < offsets[v + 1]; j++) {
+				int u = neighbors[j];
+				if(!visited[u]) {
+					visited[u] = 1;
+					frontier.push_back(u);
+				}
+			}
+			std::sort(frontier.begin(), frontier.end(), [this](int a, int b) { return degree(a) < degree(b); });
+			order.insert(order.end(), frontier.begin(), frontier.end());
+		}
+	}
+	std::reverse(order.begin(), order.end());
+	timer.end("SocialNetwork::rcm_order");
+	return order;
+}
+
+
+// distance along a Hilbert curve filling a side x side square (side a power of 2) of the cell at (x, y)
+static uint64_t hilbert_index(uint32_t side, uint32_t x, uint32_t y) {
+	uint64_t d = 0;
+	for(uint32_t s = side / 2; s > 0; s /= 2) {
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += (uint64_t)s * s * ((3 * rx) ^ ry);
+		// rotate the quadrant so the curve inside it runs the right way
+		if(ry == 0) {
+			if(rx == 1) {
+				x = side - 1 - x;
+				y = side - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+
+std::vector<int> SocialNetwork::hilbert_order() const {
+	std::vector<int> order;
+	if(lattice_width == 0) return order;
+
+	uint32_t side = 1;
+	while(side < (uint32_t)std::max(lattice_width, lattice_height)) side *= 2;
+
+	std::vector<std::pair<uint64_t,int>> keyed(num_nodes);
+	#pragma omp parallel for schedule(static)
+	for(int v = 0; v < num_nodes; v++) {
+		keyed[v] = std::make_pair(hilbert_index(side, v % lattice_width, v / lattice_width), v);
+	}
+	std::sort(keyed.begin(), keyed.end());
+
+	order.resize(num_nodes);
+	for(int v = 0; v < num_nodes; v++) order[v] = keyed[v].second;
+	return order;
+}
+
+
+DynamicNetwork::DynamicNetwork(const SocialNetwork& g, double s) : Network(g.num_nodes), slack(s) {
+	external_ids = g.external_ids;
+	internal_ids = g.internal_ids;
+	degrees.resize(num_nodes);
+	#pragma omp parallel for schedule(static)
+	for(int v = 0; v < num_nodes; v++) {
+		degrees[v] = g.degree(v);
+	}
+	num_arcs = g.num_arcs;
+
+	// lay out the copied lists through compact(), reading from a temporary dense layout
+	starts.assign(g.offsets, g.offsets + num_nodes);
+	capacities = degrees;
+	slots.assign(g.neighbors, g.neighbors + g.num_arcs);
+	slot_end = g.num_arcs;
+	compact();
+	pending.resize(MAX_THREADS());
+}
+
+
+void DynamicNetwork::sample_neighbors(int* parents, uint64_t seed) const {
+	timer.start("DynamicNetwork::sample_neighbors");
+	const int64_t* st = starts.data();
+	const int* deg = degrees.data();
+	const int* nbr = slots.data();
+	int n = num_nodes;
+
+	#pragma omp parallel for simd schedule(static)
+	for(int v = 0; v < n; v++) {
+		uint32_t d = (uint32_t)deg[v];
+		uint32_t pick = random_below(hash_random(seed, v), d);
+		parents[v] = (d > 0) ? nbr[st[v] + pick] : v;
+	}
+	timer.end("DynamicNetwork::sample_neighbors");
+}
+
+
+void DynamicNetwork::reserve_threads(int threads) {
+	if((int)pending.size() < threads) pending.resize(threads);
+}
+
+
+void DynamicNetwork::queue_arcs(int u, int v, int insert) {
+	size_t thread = THREAD_NUM();
+	if(thread < pending.size()) {
+		std::vector<ArcUpdate>& buffer = pending[thread];
+		buffer.push_back(ArcUpdate{u, v, insert});
+		buffer.push_back(ArcUpdate{v, u, insert});
+		return;
+	}
+	// a team larger than the buffers were reserved for must not index past them
+	#pragma omp critical(dynamic_network_overflow)
+	{
+		overflow.push_back(ArcUpdate{u, v, insert});
+		overflow.push_back(ArcUpdate{v, u, insert});
+	}
+}
+
+
+void DynamicNetwork::queue_insert(int u, int v) {
+	queue_arcs(u, v, 1);
+}
+
+
+void DynamicNetwork::queue_delete(int u, int v) {
+	queue_arcs(u, v, 0);
+}
+
+
+void DynamicNetwork::apply_updates() {
+	timer.start("DynamicNetwork::apply_updates");
+
+	// gather the per-thread buffers and any overflow into one batch, grouped by node with deletions first
+	std::vector<std::vector<ArcUpdate>*> buffers;
+	for(size_t t = 0; t < pending.size(); t++) buffers.push_back(&pending[t]);
+	buffers.push_back(&overflow);
+	size_t total = 0;
+	std::vector<size_t> bases(buffers.size());
+	for(size_t t = 0; t < buffers.size(); t++) {
+		bases[t] = total;
+		total += buffers[t]->size();
+	}
+	std::vector<ArcUpdate> batch(total);
+	#pragma omp parallel for schedule(static, 1)
+	for(size_t t = 0; t < buffers.size(); t++) {
+		std::copy(buffers[t]->begin(), buffers[t]->end(), batch.begin() + bases[t]);
+		buffers[t]->clear();
+	}
+	std::sort(batch.begin(), batch.end(), [](const ArcUpdate& a, const ArcUpdate& b) {
+		return (a.node != b.node) ? a.node < b.node : (a.insert != b.insert) ? a.insert < b.insert : a.other < b.other;
+	});
+
+	std::vector<size_t> groups;
+	for(size_t i = 0; i < total; i++) {
+		if(i == 0 || batch[i].node != batch[i - 1].node) groups.push_back(i);
+	}
+	groups.push_back(total);
+	int num_groups = (int)groups.size() - 1;
+
+	// each group belongs to one node, so groups are applied in parallel without conflicts.  A group stops at 
+	// the first insertion its node has no room for, recording where it stopped in resume.
+	std::vector<size_t> resume(num_groups, total);
+	int64_t arc_change = 0;
+	#pragma omp parallel for schedule(dynamic, 64) reduction(+:arc_change)
+	for(int g = 0; g < num_groups; g++) {
+		int node = batch[groups[g]].node;
+		int* list = slots.data() + starts[node];
+		int d = degrees[node];
+		int before = d;
+		for(size_t i = groups[g]; i < groups[g + 1]; i++) {
+			int other = batch[i].other;
+			int* found = std::find(list, list + d, other);
+			if(batch[i].insert == 0) {
+				if(found != list + d) {
+					*found = list[--d];
+				}
+			}
+			else if(other != node && found == list + d) {
+				if(d == capacities[node]) {
+					resume[g] = i;
+					break;
+				}
+				list[d++] = other;
+			}
+		}
+		degrees[node] = d;
+		arc_change += d - before;
+	}
+
+	// nodes that ran out of room move to the end of the slot array, with room for all their remaining insertions
+	std::vector<int> grown;
+	for(int g = 0; g < num_groups; g++) {
+		if(resume[g] < groups[g + 1]) grown.push_back(g);
+	}
+	if(!grown.empty()) {
+		std::vector<int64_t> new_starts(grown.size());
+		for(size_t k = 0; k < grown.size(); k++) {
+			int g = grown[k];
+			int node = batch[groups[g]].node;
+			new_starts[k] = slot_end;
+			garbage += capacities[node];
+			capacities[node] = capacity_for(degrees[node] + (int)(groups[g + 1] - resume[g]));
+			slot_end += capacities[node];
+		}
+		if(slot_end > (int64_t)slots.size()) slots.resize(slot_end + slot_end / 4);
+
+		#pragma omp parallel for schedule(dynamic, 16) reduction(+:arc_change)
+		for(size_t k = 0; k < grown.size(); k++) {
+			int g = grown[k];
+			int node = batch[groups[g]].node;
+			int* list = slots.data() + new_starts[k];
+			int d = degrees[node];
+			std::copy(slots.data() + starts[node], slots.data() + starts[node] + d, list);
+			starts[node] = new_starts[k];
+			for(size_t i = resume[g]; i < groups[g + 1]; i++) {
+				int other = batch[i].other;
+				if(std::find(list, list + d, other) == list + d) {
+					list[d++] = other;
+					++arc_change;
+				}
+			}
+			degrees[node] = d;
+		}
+
+		if(garbage > slot_end / 2) compact();
+	}
+
+	num_arcs += arc_change;
+	SPDLOG_TRACE(clog, "applied {} arc updates, {} nodes relocated, {} arcs", total, grown.size(), num_arcs);
+	timer.end("DynamicNetwork::apply_updates");
+}
+
+
+void DynamicNetwork::compact() {
+	timer.start("DynamicNetwork::compact");
+	std::vector<int64_t> new_starts(num_nodes);
+	int64_t end = 0;
+	for(int v = 0; v < num_nodes; v++) {
+		new_starts[v] = end;
+		capacities[v] = capacity_for(degrees[v]);
+		end += capacities[v];
+	}
+
+	std::vector<int> new_slots(end);
+	#pragma omp parallel for schedule(static)
+	for(int v = 0; v < num_nodes; v++) {
+		std::copy(slots.data() + starts[v], slots.data() + starts[v] + degrees[v], new_slots.data() + new_starts[v]);
+	}
+	starts.swap(new_starts);
+	slots.swap(new_slots);
+	slot_end = end;
+	garbage = 0;
+	timer.end("DynamicNetwork::compact");
+}
+
+
+void DynamicNetwork::queue_random_rewiring(double fraction, uint64_t seed) {
+	int64_t count = (int64_t)(num_arcs / 2 * fraction + 0.5);
+
+#pragma omp parallel
+{
+	// the team that queues may be larger than the one the buffers were sized for at construction
+	#pragma omp single
+	reserve_threads(NUM_THREADS());
+
+	#pragma omp for schedule(static)
+	for(int64_t k = 0; k < count; k++) {
+		int u = (int)random_below(hash_random(seed, 3 * k), num_nodes);
+		uint32_t d = (uint32_t)degrees[u];
+		if(d == 0) continue;
+		int v = slots[starts[u] + random_below(hash_random(seed, 3 * k + 1), d)];
+		int w = (int)random_below(hash_random(seed, 3 * k + 2), num_nodes);
+		queue_delete(u, v);
+		queue_insert(u, w);
+	}
+}
+}
+
+
+};
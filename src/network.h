@@ -0,0 +1,227 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "defines.h"
+
+
+namespace CTModels {
+
+/** \class Network
+*
+* Interface through which transmission draws parents from a graph over the individuals of a population.  
+* Nodes may have been renumbered for locality (see SocialNetwork::permuted()):  node IDs are then internal, and
+* external_ids maps each back to the ID it had when the graph was built (from the edge list, or the generator).  
+* A population placed on a renumbered graph stores its individuals in internal order, but reads and writes them 
+* in external order.  
+*/
+
+class Network {
+public:
+	int num_nodes;
+	std::vector<int> external_ids;
+	std::vector<int> internal_ids;
+
+	Network(int n) : num_nodes(n) {}
+	virtual ~Network() {}
+
+	/**
+	* Writes a uniformly chosen neighbor of each node into parents, or the node itself if it has no 
+	* neighbors.  Random values come from a counter-based hash of (seed, node), so the loop has no
+	* dependencies between nodes, vectorizes, and gives the same draws for any number of threads.  
+	*/
+	virtual void sample_neighbors(int* parents, uint64_t seed) const = 0;
+
+	/** True if node IDs have been renumbered since the graph was built. */
+	bool is_reordered() const { return !external_ids.empty(); }
+	int to_external(int v) const { return external_ids.empty() ? v : external_ids[v]; }
+	int to_internal(int v) const { return internal_ids.empty() ? v : internal_ids[v]; }
+};
+
+
+/** \class SocialNetwork
+*
+* An undirected graph over the individuals of a population, in compressed sparse row form:  the neighbors 
+* of node v are neighbors[offsets[v]] ... neighbors[offsets[v+1] - 1], sorted and without repeats or self 
+* loops.  Each undirected edge is stored once in each direction.  Graphs are built by the static factory 
+* functions, all of which assemble their edges in parallel.  
+*
+* A graph can be renumbered with permuted() so that neighbors sit close together in memory, which keeps the
+* parent reads of transmission in cache.  
+*/
+
+class SocialNetwork : public Network {
+public:
+	int64_t num_arcs;
+	int64_t* offsets;
+	int* neighbors;
+	int lattice_width = 0;
+	int lattice_height = 0;
+
+	SocialNetwork(int n, int64_t arcs);
+	~SocialNetwork();
+
+	int degree(int v) const { return (int)(offsets[v + 1] - offsets[v]); }
+
+	/**
+	* Returns a copy of the graph in which node i is node order[i] of this graph.  Each adjacency list of
+	* the copy is rebuilt in parallel and sorted, and the copy's external IDs are those of this graph.  
+	*/
+	std::shared_ptr<SocialNetwork> permuted(const std::vector<int>& order) const;
+
+	/**
+	* Reverse Cuthill-McKee ordering:  breadth-first search from a low degree node of each component, visiting
+	* neighbors in order of increasing degree, reversed.  Neighbors end up with nearby IDs, minimizing the 
+	* bandwidth of the adjacency matrix.  The search is sequential.
+	*/
+	std::vector<int> rcm_order() const;
+
+	/**
+	* Orders nodes by decreasing degree, so that the hubs, whose rows are read as parents most often, share 
+	* cache lines and pages.  Suits scale-free graphs, which have little locality for RCM to find.
+	*/
+	std::vector<int> degree_order() const;
+
+	/**
+	* Orders the cells of a lattice along a Hilbert curve, so that nearby cells in both dimensions have
+	* nearby IDs.  Returns an empty order if the graph was not built by lattice().  
+	*/
+	std::vector<int> hilbert_order() const;
+
+	/**
+	* Writes a uniformly chosen neighbor of each node into parents, or the node itself if it has no 
+	* neighbors.  Random values come from a counter-based hash of (seed, node), so the loop has no
+	* dependencies between nodes, vectorizes, and gives the same draws for any number of threads.  
+	*/
+	void sample_neighbors(int* parents, uint64_t seed) const;
+
+	/**
+	* Builds a graph from arcs (src[i], dst[i]).  Each pair is taken as an undirected edge; self loops and 
+	* repeated edges are dropped.  
+	*/
+	static std::shared_ptr<SocialNetwork> from_edges(int n, const std::vector<int>& src, const std::vector<int>& dst);
+
+	/**
+	* Reads an edge list, one pair of 0-based node IDs per line, ignoring blank lines and lines starting
+	* with #.  The graph has num_nodes nodes, or max ID + 1 if num_nodes is 0.  Returns an empty pointer 
+	* if the file cannot be read, or names a node out of range.  
+	*/
+	static std::shared_ptr<SocialNetwork> from_edge_list(const std::string& path, int num_nodes);
+
+	/** A width x height torus, each node joined to its four von Neumann neighbors. */
+	static std::shared_ptr<SocialNetwork> lattice(int width, int height);
+
+	/** An Erdos-Renyi random graph with n nodes and about n * mean_degree / 2 edges. */
+	static std::shared_ptr<SocialNetwork> erdos_renyi(int n, double mean_degree, uint64_t seed);
+
+	/**
+	* A Watts-Strogatz small world:  a ring on which each node is joined to its k / 2 nearest neighbors on
+	* either side, with each edge rewired to a random endpoint with probability beta.
+	*/
+	static std::shared_ptr<SocialNetwork> small_world(int n, int k, double beta, uint64_t seed);
+
+	/**
+	* A Barabasi-Albert scale-free graph in which each new node attaches m edges by preferential attachment.
+	* Generated with the edge copy model:  each new edge's endpoint copies an endpoint of a uniformly chosen
+	* earlier edge, which is preferential attachment.  The random choices are fixed in advance by hashing,
+	* so every edge can be resolved independently (in parallel) by following its chain of copies.
+	*/
+	static std::shared_ptr<SocialNetwork> scale_free(int n, int m, uint64_t seed);
+};
+
+
+/** \class DynamicNetwork
+*
+* An undirected graph whose edges change between generations.  Each node's neighbors occupy a run of slots
+* with room to grow:  neighbors of v are slots[starts[v]] ... slots[starts[v] + degrees[v] - 1], in no 
+* particular order, inside a region of capacities[v] slots.  
+*
+* Changes are queued with queue_insert() and queue_delete() into per-thread buffers, from any number of threads,
+* while transmission samples neighbors from the unchanged graph.  apply_updates(), called between generations, 
+* applies the whole batch:  updates are grouped by node and each node's group is applied in parallel, deletions 
+* before insertions.  Nodes that outgrow their region move to new space at the end of the slot array, and the 
+* holes they leave are reclaimed by compacting the whole array once they make up half of it.  
+*/
+
+class DynamicNetwork : public Network {
+private:
+	struct ArcUpdate {
+		int node;
+		int other;
+		int insert;
+	};
+
+	std::vector<std::vector<ArcUpdate>> pending;
+	std::vector<ArcUpdate> overflow;
+	double slack;
+	int64_t slot_end = 0;
+	int64_t garbage = 0;
+
+	int capacity_for(int degree) const { return degree + (int)(degree * slack) + 2; }
+	void queue_arcs(int u, int v, int insert);
+
+public:
+	std::vector<int64_t> starts;
+	std::vector<int> degrees;
+	std::vector<int> capacities;
+	std::vector<int> slots;
+	int64_t num_arcs = 0;
+
+	/**
+	* Copies a static graph, including its node numbering, giving each node room for slack times its degree
+	* plus a few neighbors more.  
+	*/
+	DynamicNetwork(const SocialNetwork& g, double slack);
+
+	int degree(int v) const { return degrees[v]; }
+
+	void sample_neighbors(int* parents, uint64_t seed) const;
+
+	/** 
+	* Queues the edge (u, v) for insertion; ignored if it already exists, or u == v.  Updates may be queued from
+	* the threads of one parallel region at a time, each into its own buffer.  Threads beyond those reserved
+	* with reserve_threads() share one locked buffer instead.  
+	*/
+	void queue_insert(int u, int v);
+
+	/** Queues the edge (u, v) for deletion; ignored if it does not exist. */
+	void queue_delete(int u, int v);
+
+	/** Ensures a buffer of its own for each of threads threads.  Must not run concurrently with queueing. */
+	void reserve_threads(int threads);
+
+	/** Applies every queued update.  Must not run concurrently with sample_neighbors(). */
+	void apply_updates();
+
+	/** Rewrites the slot array with each node's neighbors contiguous, and slack room for growth. */
+	void compact();
+
+	/**
+	* Queues the rewiring of a fraction of all edges:  for each, a random node drops a random neighbor and
+	* links to a random node instead, which keeps the number of edges roughly constant.  
+	*/
+	void queue_random_rewiring(double fraction, uint64_t seed);
+};
+
+
+/**
+* Counter-based random numbers:  a 64-bit hash (the splitmix64 finalizer) of a seed and a counter, used
+* wherever random values must be drawn independently per element.  
+*/
+inline uint64_t hash_random(uint64_t seed, uint64_t counter) {
+	uint64_t x = seed + (counter + 1) * 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/**
+* Maps a random 64-bit value onto [0, range) by multiplying its high 32 bits, avoiding a division.
+*/
+inline uint32_t random_below(uint64_t r, uint32_t range) {
+	return (uint32_t)(((r >> 32) * (uint64_t)range) >> 32);
+}
+
+};
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <math.h>
+#include <spdlog/spdlog.h>
+
+#include "neutrality.h"
+#include "statistics.h"
+#include "globals.h"
+#include "timer.h"
+
+namespace spd = spdlog;
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+/**
+* Solves Ewens' estimating equation k = sum_{i=0}^{n-1} theta / (theta + i) for theta by bisection
+* on a log scale.  The left hand side is monotone in theta, so bisection always converges.  
+*/
+static double estimate_theta(int n, int k) {
+	double lo = log(1e-8);
+	double hi = log(1e8);
+	for(int iter = 0; iter < 100; iter++) {
+		double mid = 0.5 * (lo + hi);
+		double theta = exp(mid);
+		double expected_k = 0.0;
+		for(int i = 0; i < n; i++) {
+			expected_k += theta / (theta + i);
+		}
+		if(expected_k < k) lo = mid;
+		else hi = mid;
+	}
+	return exp(0.5 * (lo + hi));
+}
+
+
+/**
+* Log probability of an unordered configuration of trait counts under the Ewens sampling formula
+* conditioned on n and k, up to the constant log(n! / |S(n,k)|) which is shared by every
+* configuration with the same n and k:  -sum_j log(n_j) - sum_i log(beta_i!), where beta_i
+* is the number of traits represented exactly i times.  Sorts the sizes in place.
+*/
+static double conditional_log_prob(std::vector<int>& sizes, int k) {
+	std::sort(sizes.begin(), sizes.begin() + k);
+	double lp = 0.0;
+	int run = 1;
+	for(int j = 0; j < k; j++) {
+		lp -= log((double)sizes[j]);
+		if(j + 1 < k && sizes[j + 1] == sizes[j]) {
+			++run;
+		}
+		else {
+			lp -= lgamma(run + 1.0);
+			run = 1;
+		}
+	}
+	return lp;
+}
+
+
+static double homozygosity(const std::vector<int>& sizes, int k, int n) {
+	double sum_sq = 0.0;
+	for(int j = 0; j < k; j++) {
+		sum_sq += (double)sizes[j] * sizes[j];
+	}
+	return sum_sq / ((double)n * n);
+}
+
+
+/**
+* Draws a random configuration of n genes with exactly k traits from the Ewens sampling formula, 
+* by running Hoppe's urn at the Ewens estimate of theta and rejecting any draw whose number of 
+* traits is not k.  Conditional on k, the Ewens distribution does not depend on theta, so the
+* accepted draws are exact; theta only sets the acceptance rate, which is highest at the estimate.  
+*
+* Whether gene i founds a new trait is an independent Bernoulli(theta / (theta + i)) event (the
+* Feller coupling), so each attempt first draws only those indicators and is abandoned as soon as 
+* it overshoots k or can no longer reach it.  Genes are assigned to traits only for accepted draws.
+*/
+static void draw_conditional_configuration(int n, int k, double theta, std::mt19937_64& eng,
+	std::vector<int>& allele_of_gene, std::vector<int>& sizes) {
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+	bool accepted = false;
+	while(!accepted) {
+		int num_alleles = 0;
+		accepted = true;
+		for(int i = 0; i < n; i++) {
+			bool is_new = uniform(eng) < theta / (theta + i);
+			allele_of_gene[i] = is_new ? -1 : 0;
+			num_alleles += is_new;
+			if(num_alleles > k || num_alleles + (n - i - 1) < k) { 
+				accepted = false; 
+				break; 
+			}
+		}
+	}
+
+	int num_alleles = 0;
+	for(int i = 0; i < n; i++) {
+		if(allele_of_gene[i] < 0) {
+			allele_of_gene[i] = num_alleles;
+			sizes[num_alleles] = 1;
+			++num_alleles;
+		}
+		else {
+			std::uniform_int_distribution<int> prior_gene{0, i - 1};
+			int a = allele_of_gene[prior_gene(eng)];
+			allele_of_gene[i] = a;
+			++sizes[a];
+		}
+	}
+}
+
+
+std::shared_ptr<NeutralityTests> calculate_neutrality_tests(std::shared_ptr<TraitFrequencies> tf, int replicates) {
+	timer.start("neutrality::calculate_neutrality_tests");
+	std::shared_ptr<NeutralityTests> nt(new NeutralityTests(tf->numloci, replicates));
+
+	// Monte Carlo tallies are shared across the team and reduced by each locus' replicate loop
+	double sum_f;
+	int ew_hits;
+	int slatkin_hits;
+
+#pragma omp parallel 
+{
+	// each thread gets its own independently seeded engine, as in generate_uniform_int()
+	std::random_device rd;
+	std::mt19937_64 eng(rd());
+	std::vector<int> allele_of_gene;
+	std::vector<int> sizes;
+
+	for(int locus = 0; locus < tf->numloci; locus++) {
+		int* row = tf->trait_counts + (size_t)locus * tf->max_num_traits;
+
+		// every thread derives the same observed statistics, so no synchronization is needed 
+		// before the replicate loop
+		std::vector<int> observed;
+		int n = 0;
+		for(int trait = 0; trait < tf->max_num_traits; trait++) {
+			if(row[trait] > 0) {
+				observed.push_back(row[trait]);
+				n += row[trait];
+			}
+		}
+		int k = observed.size();
+		double f_obs = homozygosity(observed, k, (n > 0) ? n : 1);
+		double lp_obs = conditional_log_prob(observed, k);
+
+		#pragma omp single
+		{
+			sum_f = 0.0;
+			ew_hits = 0;
+			slatkin_hits = 0;
+			nt->sample_size_by_locus[locus] = n;
+			nt->num_traits_by_locus[locus] = k;
+			nt->observed_homozygosity_by_locus[locus] = f_obs;
+			nt->expected_homozygosity_by_locus[locus] = f_obs;
+			nt->ewens_watterson_p_by_locus[locus] = 1.0;
+			nt->slatkin_exact_p_by_locus[locus] = 1.0;
+		}
+
+		// with a single trait, or every individual carrying its own trait, there is only one
+		// possible configuration and neither test has anything to say
+		if(k <= 1 || k >= n || replicates <= 0) 
+			continue;
+
+		double theta = estimate_theta(n, k);
+		allele_of_gene.resize(n);
+		sizes.resize(k);
+
+		#pragma omp for reduction(+:sum_f,ew_hits,slatkin_hits)
+		for(int rep = 0; rep < replicates; rep++) {
+			draw_conditional_configuration(n, k, theta, eng, allele_of_gene, sizes);
+			double f = homozygosity(sizes, k, n);
+			double lp = conditional_log_prob(sizes, k);
+			sum_f += f;
+			if(f <= f_obs + 1e-12) ++ew_hits;
+			if(lp <= lp_obs + 1e-9) ++slatkin_hits;
+		}
+
+		#pragma omp single
+		{
+			nt->expected_homozygosity_by_locus[locus] = sum_f / replicates;
+			nt->ewens_watterson_p_by_locus[locus] = (double)ew_hits / replicates;
+			nt->slatkin_exact_p_by_locus[locus] = (double)slatkin_hits / replicates;
+		}
+	}
+} // end pragma omp parallel
+
+	timer.end("neutrality::calculate_neutrality_tests");
+	return nt;
+}
+
+
+void print_neutrality_tests(std::shared_ptr<NeutralityTests> nt) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+
+		for(int locus = 0; locus < nt->numloci; locus++) {
+			std::stringstream s;
+			s << "neutrality @ locus: " << locus << ": n: " << nt->sample_size_by_locus[locus];
+			s << " k: " << nt->num_traits_by_locus[locus];
+			s << std::fixed << std::setprecision(4);
+			s << " F obs: " << nt->observed_homozygosity_by_locus[locus];
+			s << " F exp: " << nt->expected_homozygosity_by_locus[locus];
+			s << " EW p: " << nt->ewens_watterson_p_by_locus[locus];
+			s << " Slatkin p: " << nt->slatkin_exact_p_by_locus[locus];
+			SPDLOG_DEBUG(clog,"{}",s.str());
+		}
+	}
+}
+
+
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include "defines.h"
+#include "statistics.h"
+
+
+namespace CTModels {
+
+/** \class NeutralityTests
+*
+* NeutralityTests bundles the per-locus results of the Ewens-Watterson homozygosity test and 
+* Slatkin's exact test, both computed by Monte Carlo sampling from the Ewens sampling formula 
+* conditioned on the observed sample size and number of traits at each locus.  
+*
+*   - sample_size_by_locus:  number of individuals counted at the locus (n)
+*   - num_traits_by_locus:  number of distinct traits observed at the locus (k)
+*   - observed_homozygosity_by_locus:  F = sum(p^2) for the observed counts
+*   - expected_homozygosity_by_locus:  mean of F across the neutral replicates
+*   - ewens_watterson_p_by_locus:  fraction of neutral replicates with F <= observed F
+*   - slatkin_exact_p_by_locus:  fraction of neutral replicates whose configuration is no more 
+*     probable than the observed one under the conditional Ewens distribution
+*
+* Loci where the test is uninformative (k == 1 or k == n) report p-values of 1.0.
+*/
+
+class NeutralityTests {
+public:
+	int* sample_size_by_locus;
+	int* num_traits_by_locus;
+	double* observed_homozygosity_by_locus;
+	double* expected_homozygosity_by_locus;
+	double* ewens_watterson_p_by_locus;
+	double* slatkin_exact_p_by_locus;
+	int numloci;
+	int replicates;
+
+	NeutralityTests(int numloci, int replicates) : numloci(numloci), replicates(replicates) {
+		int bufsize = numloci * sizeof(int);
+		int dbl_bufsize = numloci * sizeof(double);
+		sample_size_by_locus = (int*) ALIGNED_MALLOC(bufsize);
+		num_traits_by_locus = (int*) ALIGNED_MALLOC(bufsize);
+		observed_homozygosity_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
+		expected_homozygosity_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
+		ewens_watterson_p_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
+		slatkin_exact_p_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
+	}
+
+	~NeutralityTests() {
+		FREE(sample_size_by_locus);
+		FREE(num_traits_by_locus);
+		FREE(observed_homozygosity_by_locus);
+		FREE(expected_homozygosity_by_locus);
+		FREE(ewens_watterson_p_by_locus);
+		FREE(slatkin_exact_p_by_locus);
+	}
+};
+
+
+/* Defined in neutrality.cpp */
+
+/**
+* Runs the Ewens-Watterson and Slatkin exact tests on every locus of a TraitFrequencies object, using
+* the given number of Monte Carlo replicates per locus.  Replicates are spread across the OpenMP team, 
+* with each thread drawing from its own random number stream.  
+*/
+std::shared_ptr<NeutralityTests> calculate_neutrality_tests(std::shared_ptr<TraitFrequencies> tf, int replicates);
+
+void print_neutrality_tests(std::shared_ptr<NeutralityTests> nt);
+
+};
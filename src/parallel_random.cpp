@@ -1,4 +1,6 @@
 #include <random>
+#include <algorithm>
+#include <stdint.h>
 
 namespace CTModels {
 
@@ -20,4 +22,24 @@ void generate_uniform_int(int begin, int end, int num_variates, int* variates) {
 
 } // end function
 
+
+// variates drawn from each seeded engine; large enough that seeding costs little next to drawing
+static const int SEEDED_BLOCK_SIZE = 8192;
+
+void generate_uniform_int(int begin, int end, int num_variates, int* variates, uint64_t seed) {
+	int num_blocks = (num_variates + SEEDED_BLOCK_SIZE - 1) / SEEDED_BLOCK_SIZE;
+
+#pragma omp parallel for schedule(static) shared(variates)
+	for(int block = 0; block < num_blocks; block++) {
+		std::seed_seq seq{(uint32_t)seed, (uint32_t)(seed >> 32), (uint32_t)block};
+		std::mt19937_64 eng(seq);
+		std::uniform_int_distribution<int> uniform_int{begin, end - 1};
+
+		int last = std::min(num_variates, (block + 1) * SEEDED_BLOCK_SIZE);
+		for(int i = block * SEEDED_BLOCK_SIZE; i < last; i++) {
+			variates[i] = uniform_int(eng);
+		}
+	}
+}
+
 }; // end namespace
\ No newline at end of file
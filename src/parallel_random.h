@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 
 namespace CTModels {
 
@@ -12,5 +14,12 @@ namespace CTModels {
 
 void generate_uniform_int(int begin, int end, int num_variates, int* variates);
 
+/**
+* Seeded form of generate_uniform_int().  Variates are drawn in fixed size blocks, each from an engine 
+* seeded with (seed, block number), so the values depend only on the seed and never on the number of 
+* threads or how blocks are scheduled among them.  
+*/
+void generate_uniform_int(int begin, int end, int num_variates, int* variates, uint64_t seed);
+
 
 };
\ No newline at end of file
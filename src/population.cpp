@@ -8,6 +8,8 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/logger.h>
 #include <memory>
+#include <unordered_set>
+#include <unordered_map>
 
 #include "population.h"
 #include "statistics.h"
@@ -15,6 +17,14 @@
 #include "timer.h"
 #include "globals.h"
 #include "parallel_random.h"
+#include "assemblage.h"
+#include "lifetimes.h"
+#include "topk.h"
+#include "configurations.h"
+#include "classification.h"
+#include "association.h"
+#include "checkpoint.h"
+#include "statedump.h"
 
 using namespace CTModels;
 
@@ -23,6 +33,25 @@ extern CTModels::Timer timer;
 namespace CTModels {
 
 
+/*
+* Renumbers the traits at one locus of draw[begin, end) densely, in order of first appearance, continuing the
+* numbering already held in compact_id and trait_ids, and writes the compact IDs to column[begin, end).  A null
+* draw stands for every individual in order.  The map grows with the distinct traits drawn, so compaction costs
+* time and memory in proportion to the individuals compacted, not to the number of traits ever introduced.
+*/
+static void compact_locus(const int* traits, int numloci, int locus, const int* draw, int begin, int end,
+		std::unordered_map<int, int>& compact_id, std::vector<int>& trait_ids, int* column) {
+	for(int i = begin; i < end; i++) {
+		int indiv = draw ? draw[i] : i;
+		int trait = traits[(size_t)indiv * numloci + locus];
+		auto found = compact_id.insert(std::make_pair(trait, (int)trait_ids.size()));
+		if(found.second) trait_ids.push_back(trait);
+		column[i] = found.first->second;
+	}
+}
+
+
+
 /**
 * Population destructor.  Normally not reached if we run a single population and then exit from main(),
 * but in situations where we might run simulations in a loop, we don't want to leak memory for whole 
@@ -32,21 +61,16 @@ Population::~Population() {
 	SPDLOG_TRACE(clog,"deallocating block prev_population_traits {:p}", (void*)prev_population_traits); 
 	SPDLOG_TRACE(clog,"deallocating block population_traits {:p}", (void*)population_traits); 
 	SPDLOG_TRACE(clog,"deallocating block indiv_to_copy {:p}", (void*)indiv_to_copy);
-	FREE(prev_population_traits);
-	FREE(population_traits);
+	// after a restart, one of the two trait arrays lives in the checkpoint mapping, which is
+	// released along with the MappedCheckpoint
+	int* mapped_traits = checkpoint ? checkpoint->traits : nullptr;
+	if(prev_population_traits != mapped_traits) FREE(prev_population_traits);
+	if(population_traits != mapped_traits) FREE(population_traits);
 	FREE(indiv_to_copy);
 }
 
 
-void Population::initialize() {
-	timer.start("population::initialize");
-	// Initialize needed random number generators
-	std::random_device rd_mt;
-	std::mt19937_64 t_mt(rd_mt());
-
-	this->mt = t_mt;
-
-
+void Population::setup_distributions() {
 	// in debug printing, we want fixed columns, with the number of digits appropriate given the 
 	// max number of traits or population size
 	char buffer[32];
@@ -71,29 +95,74 @@ void Population::initialize() {
 	std::poisson_distribution<int> p{mutation_rate};
 	this->poisson_dist = p;
 
-	// next_trait stores the next new mutation/innovation for each locus/dimension, and each slot
-	// is incremented when a new trait is handed out.  Since there are "inittraits" in the initial 
-	// population, we initialize this array of values to inittraits + 1.  
-	for(int i = 0; i < this->numloci; i++) {
-		next_trait.push_back(this->inittraits + 1);
+}
+
+
+void Population::reserve_arrays() {
+	// after a restart, one of the trait arrays belongs to the checkpoint mapping; give it back
+	if(checkpoint) {
+		if(population_traits == checkpoint->traits) population_traits = nullptr;
+		if(prev_population_traits == checkpoint->traits) prev_population_traits = nullptr;
+		FREE(population_traits);
+		FREE(prev_population_traits);
+		population_traits = prev_population_traits = nullptr;
+		trait_capacity = 0;
+		checkpoint.reset();
 	}
 
-	auto trait_bufsize = (numloci * popsize) * sizeof(int);
-	population_traits = (int*) ALIGNED_MALLOC(trait_bufsize);
-	prev_population_traits = (int*) ALIGNED_MALLOC(trait_bufsize);
+	size_t cells = (size_t)numloci * popsize;
+	if(cells > trait_capacity) {
+		FREE(population_traits);
+		FREE(prev_population_traits);
+		population_traits = (int*) ALIGNED_MALLOC(cells * sizeof(int));
+		prev_population_traits = (int*) ALIGNED_MALLOC(cells * sizeof(int));
+		trait_capacity = cells;
+	}
 	//SPDLOG_DEBUG(clog, "Pop initializing pop traits array {:p} as {}x{} block with size {}", (void*)population_traits, popsize, numloci, trait_bufsize);
 	//SPDLOG_DEBUG(clog, "Pop initializing prev pop array {:p} as {}x{} block with size {}", (void*)prev_population_traits, popsize, numloci, trait_bufsize);
 
-	int num_variates = popsize * numloci;
-	generate_uniform_int(0, inittraits - 1, num_variates, population_traits);
-
 	// Initialize a buffer to hold random numbers indicating which individuals are copied
 	// in each time step
-	auto indiv_bufsize = popsize * sizeof(int);
-	indiv_to_copy = (int*) ALIGNED_MALLOC(indiv_bufsize);
+	if(popsize > indiv_capacity) {
+		FREE(indiv_to_copy);
+		indiv_to_copy = (int*) ALIGNED_MALLOC(popsize * sizeof(int));
+		indiv_capacity = popsize;
+	}
 	//SPDLOG_DEBUG(clog, "Pop initializing indiv_to_copy array {:p} as {} block with size {}", (void*)indiv_to_copy, popsize, indiv_bufsize);
+}
+
+
+void Population::initialize() {
+	timer.start("population::initialize");
+	// Initialize needed random number generators.  Everything random in the simulation is drawn from mt
+	// or seeded from it, so a seeded population is reproducible.  
+	if(seeded) {
+		this->mt.seed(seed_value);
+	}
+	else {
+		std::random_device rd_mt;
+		std::mt19937_64 t_mt(rd_mt());
+		this->mt = t_mt;
+	}
 
+	setup_distributions();
 
+	// samples are drawn from their own engine, seeded once here, so sampling at any size or interval
+	// leaves the trajectory of the simulation unchanged
+	this->sample_mt.seed(mt());
+
+	// next_trait stores the next new mutation/innovation for each locus/dimension, and each slot
+	// is incremented when a new trait is handed out.  Since there are "inittraits" in the initial 
+	// population, we initialize this array of values to inittraits + 1.  
+	next_trait.assign(this->numloci, this->inittraits + 1);
+
+	// buffers are only allocated when larger than any this object has held, so a population reset for
+	// another replicate reuses the memory (and the already faulted-in pages) of the last one
+	reserve_arrays();
+	auto trait_bufsize = (numloci * popsize) * sizeof(int);
+
+	int num_variates = popsize * numloci;
+	generate_uniform_int(0, inittraits - 1, num_variates, population_traits, mt());
 
 	// For the first generation only, the previous population is the same as the initial population
 	memcpy(prev_population_traits, population_traits, trait_bufsize);
@@ -101,17 +170,105 @@ void Population::initialize() {
 }
 
 
+void Population::reset(int p, int n, int i, double r) {
+	popsize = p;
+	numloci = n;
+	inittraits = i;
+	innovation_rate = r;
+	generation = 0;
+	accumulator.reset();
+	registry.reset();
+	initialize();
+}
+
+
+void Population::write_checkpoint(CheckpointWriter& writer, ruletype rule) {
+	timer.start("population::write_checkpoint");
+	PopulationSnapshot& snap = writer.begin_checkpoint();
+	snap.header.numloci = numloci;
+	snap.header.popsize = popsize;
+	snap.header.inittraits = inittraits;
+	snap.header.generation = generation;
+	snap.header.innovation_rate = innovation_rate;
+	snap.header.rule = rule;
+	snap.next_trait = next_trait;
+
+	// the Poisson distribution caches a normal variate between draws at large means, so it is part of the
+	// random state along with the engines
+	std::stringstream rng;
+	rng << mt << ' ' << poisson_dist << ' ' << sample_mt;
+	snap.rng_state = rng.str();
+
+	size_t cells = (size_t)popsize * numloci;
+	snap.reserve_traits(cells);
+	copy_external_order(snap.traits);
+
+	writer.commit();
+	timer.end("population::write_checkpoint");
+}
+
+
+void Population::dump_state(StateDumpWriter& writer) {
+	timer.start("population::dump_state");
+	copy_external_order(writer.claim(generation));
+	writer.publish();
+	timer.end("population::dump_state");
+}
+
+
+Population* Population::from_checkpoint(const std::string& path, ruletype& rule) {
+	timer.start("population::from_checkpoint");
+	std::shared_ptr<MappedCheckpoint> mc = MappedCheckpoint::open(path);
+	if(!mc) {
+		timer.end("population::from_checkpoint");
+		return nullptr;
+	}
+
+	const CheckpointHeader& h = *mc->header;
+	if(h.rule != BASICWF && h.rule != WFIA) {
+		clog->error("checkpoint {} records an unknown copying rule {}", path, h.rule);
+		timer.end("population::from_checkpoint");
+		return nullptr;
+	}
+	rule = (ruletype)h.rule;
+	Population* pop = new Population(h.popsize, h.numloci, h.inittraits, h.innovation_rate);
+	pop->generation = h.generation;
+	pop->checkpoint = mc;
+	pop->setup_distributions();
+
+	std::stringstream rng(mc->rng_state);
+	rng >> pop->mt >> pop->poisson_dist >> pop->sample_mt;
+	if(!rng) {
+		clog->error("checkpoint {} has a malformed random number state", path);
+		delete pop;
+		timer.end("population::from_checkpoint");
+		return nullptr;
+	}
+	pop->next_trait.assign(mc->next_trait, mc->next_trait + h.numloci);
+
+	// The current generation is used in place, from the copy-on-write mapping.  Only the array it swaps
+	// with is allocated, and it needs no contents since the next step overwrites it.
+	pop->population_traits = mc->traits;
+	pop->prev_population_traits = (int*) ALIGNED_MALLOC((size_t)h.popsize * h.numloci * sizeof(int));
+	pop->indiv_to_copy = (int*) ALIGNED_MALLOC(h.popsize * sizeof(int));
+	pop->indiv_capacity = h.popsize;
+
+	timer.end("population::from_checkpoint");
+	return pop;
+}
+
+
 
 std::shared_ptr<TraitFrequencies> Population::tabulate_trait_counts() {
 	timer.start("population::tabulate_trait_counts");
 	// allocate space for the largest value in any locus
 	// array of counts will be a rectangular array numloci * largest_locus_value
-	// technically, the largest_locus_value is 1 greater than any trait value seen at any locus, 
-	// so we trimmed by one
+	// next_trait is 1 greater than any trait value handed out at a locus, so it is exactly
+	// the number of columns needed to hold trait values [0, next_trait)
 	// MEM:  dynamically allocated locus_counts is freed in the destructor of TraitFrequencies
 
 	auto result = std::max_element(next_trait.begin(), next_trait.end());
-	int largest_locus_value = *result - 1;
+	int largest_locus_value = *result;
 
 	// declared as a std::unique_ptr, because we want the TF object from the last time tabulate was called
 	// to clean itsetf up once there isn't a reference anymore.
@@ -126,55 +283,429 @@ std::shared_ptr<TraitFrequencies> Population::tabulate_trait_counts() {
 			++locus_counts[locus * largest_locus_value + trait_at_locus];
 		}
 	}
+	tf->build_occupancy();
+	if(registry) {
+		registry->observe(tf, generation);
+	}
 	timer.end("population::tabulate_trait_counts");
 	return tf;
 }
 
 
+void Population::draw_sample_individuals(int sample_size, bool with_replacement, std::vector<int>& sample) {
+	sample.clear();
+	sample.reserve(sample_size);
+
+	if(with_replacement) {
+		for(int i = 0; i < sample_size; i++) {
+			sample.push_back(uniform_pop(this->sample_mt));
+		}
+		return;
+	}
+
+	// Floyd's algorithm picks a uniform subset of sample_size individuals with sample_size draws,
+	// without touching an index array of popsize entries.  The subset comes out in a biased order, 
+	// so it is shuffled to make every prefix a uniform subset too.
+	std::unordered_set<int> chosen;
+	chosen.reserve(sample_size * 2);
+	for(int j = popsize - sample_size; j < popsize; j++) {
+		std::uniform_int_distribution<int> u{0, j};
+		int t = u(this->sample_mt);
+		if(chosen.insert(t).second) {
+			sample.push_back(t);
+		}
+		else {
+			chosen.insert(j);
+			sample.push_back(j);
+		}
+	}
+	std::shuffle(sample.begin(), sample.end(), this->sample_mt);
+}
+
+
+std::vector<std::shared_ptr<TraitFrequencies>> Population::tabulate_sample_trait_counts(const std::vector<int>& sample_sizes, bool with_replacement) {
+	timer.start("population::tabulate_sample_trait_counts");
 
+	// visit the requested sizes in increasing order, so counting proceeds along a single draw
+	int num_sizes = sample_sizes.size();
+	std::vector<int> capped(num_sizes);
+	std::vector<int> order(num_sizes);
+	int max_size = 0;
+	for(int i = 0; i < num_sizes; i++) {
+		capped[i] = with_replacement ? sample_sizes[i] : std::min(sample_sizes[i], popsize);
+		max_size = std::max(max_size, capped[i]);
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&capped](int a, int b) { return capped[a] < capped[b]; });
+
+	std::vector<int> sample;
+	draw_sample_individuals(max_size, with_replacement, sample);
+
+	// Renumber the sampled traits densely at each locus, in order of first appearance along the draw.  Every
+	// prefix of the draw then uses compact IDs [0, distinct traits in the prefix), which is recorded at each size.
+	std::vector<int> compact((size_t)numloci * max_size);
+	std::vector<std::vector<int>> trait_ids(numloci);
+	std::vector<int> distinct((size_t)num_sizes * numloci);
+
+	#pragma omp parallel for schedule(dynamic)
+	for(int locus = 0; locus < numloci; locus++) {
+		std::unordered_map<int, int> compact_id;
+		compact_id.reserve(std::min(max_size, next_trait[locus]));
+		int* column = compact.data() + (size_t)locus * max_size;
+		int counted = 0;
+		for(int s = 0; s < num_sizes; s++) {
+			int target = capped[order[s]];
+			compact_locus(population_traits, numloci, locus, sample.data(), counted, target, compact_id, trait_ids[locus], column);
+			counted = target;
+			distinct[(size_t)s * numloci + locus] = trait_ids[locus].size();
+		}
+	}
 
+	// Counts run forward into the TraitFrequencies for the current size, as wide as the most diverse locus
+	// of that sample.  Whenever a size is reached, its counts are copied forward into the next larger 
+	// sample's buffer, and counting continues there.  
+	std::vector<std::shared_ptr<TraitFrequencies>> samples(num_sizes);
+	int counted = 0;
+	std::shared_ptr<TraitFrequencies> prev_tf;
 
+	for(int s = 0; s < num_sizes; s++) {
+		const int* size_distinct = distinct.data() + (size_t)s * numloci;
+		int width = std::max(1, *std::max_element(size_distinct, size_distinct + numloci));
+		std::shared_ptr<TraitFrequencies> tf(new TraitFrequencies(numloci, width));
+		tf->trait_ids.assign((size_t)numloci * width, -1);
+		int target = capped[order[s]];
 
-void Population::step_basicwf() {
-	// Prepare by copying current state to previous state, before doing transmission 
-	// algorithm
-	swap_population_arrays();
+		for(int locus = 0; locus < numloci; locus++) {
+			int* locus_counts = tf->trait_counts + (size_t)locus * width;
+			if(prev_tf) {
+				memcpy(locus_counts, prev_tf->trait_counts + (size_t)locus * prev_tf->max_num_traits, prev_tf->max_num_traits * sizeof(int));
+			}
+			const int* column = compact.data() + (size_t)locus * max_size;
+			for(int i = counted; i < target; i++) {
+				++locus_counts[column[i]];
+			}
+			std::copy(trait_ids[locus].begin(), trait_ids[locus].begin() + size_distinct[locus], tf->trait_ids.begin() + (size_t)locus * width);
+		}
+		counted = target;
 
-	generate_uniform_int(0, popsize, popsize, indiv_to_copy);
+		tf->build_occupancy();
+		samples[order[s]] = tf;
+		prev_tf = tf;
+	}
 
+	timer.end("population::tabulate_sample_trait_counts");
+	return samples;
+}
+
+
+std::shared_ptr<TopTraits> Population::tabulate_top_traits(int k, int sketch_capacity) {
+	timer.start("population::tabulate_top_traits");
+	int num_threads = MAX_THREADS();
+	std::vector<std::vector<SpaceSavingSketch>> sketches(num_threads, std::vector<SpaceSavingSketch>(numloci, SpaceSavingSketch(sketch_capacity)));
 
-	// Basic Wright-Fisher dynamics without innovation
 #pragma omp parallel 
 {
+	std::vector<SpaceSavingSketch>& mine = sketches[THREAD_NUM()];
 	int indiv;
 	#pragma omp for private(indiv)
 	for(indiv = 0; indiv < popsize; indiv++) {
-		int tocopy = indiv_to_copy[indiv];
-
 		for(int locus = 0; locus < numloci; locus++) {
-			population_traits[indiv * numloci + locus] = prev_population_traits[tocopy * numloci + locus];
+			mine[locus].add(population_traits[indiv * numloci + locus]);
+		}
+	}
+}
+
+	std::shared_ptr<TopTraits> top(new TopTraits(numloci, k, true));
+	for(int locus = 0; locus < numloci; locus++) {
+		for(int t = 1; t < num_threads; t++) {
+			sketches[0][locus].merge(sketches[t][locus]);
+		}
+		top->top_by_locus[locus] = sketches[0][locus].top(k);
+	}
+
+	timer.end("population::tabulate_top_traits");
+	return top;
+}
+
+
+std::shared_ptr<ConfigurationFrequencies> Population::tabulate_configurations() {
+	timer.start("population::tabulate_configurations");
+
+	// The top bits of each row's hash pick its partition, so identical rows always meet in the same one
+	const int partition_bits = 8;
+	const int num_partitions = 1 << partition_bits;
+	int num_threads = MAX_THREADS();
+
+	uint64_t* hashes = (uint64_t*) ALIGNED_MALLOC(popsize * sizeof(uint64_t));
+	int* partitioned = (int*) ALIGNED_MALLOC(popsize * sizeof(int));
+	std::vector<int> partition_offsets((size_t)num_threads * num_partitions + 1, 0);
+
+	struct ConfigEntry { int row; int count; int next; };
+	std::vector<std::vector<ConfigEntry>> entries_by_partition(num_partitions);
+
+#pragma omp parallel 
+{
+	int thread = THREAD_NUM();
+
+	#pragma omp for simd schedule(static)
+	for(int indiv = 0; indiv < popsize; indiv++) {
+		hashes[indiv] = hash_configuration(population_traits + (size_t)indiv * numloci, numloci);
+	}
+
+	// Radix partition the individuals by hash.  Each thread histograms its static block, the histograms
+	// are prefix summed in partition-major order, and each thread then scatters its own block.  
+	std::vector<int> histogram(num_partitions, 0);
+	#pragma omp for schedule(static)
+	for(int indiv = 0; indiv < popsize; indiv++) {
+		++histogram[hashes[indiv] >> (64 - partition_bits)];
+	}
+	for(int p = 0; p < num_partitions; p++) {
+		partition_offsets[(size_t)p * num_threads + thread + 1] = histogram[p];
+	}
+	#pragma omp barrier
+	#pragma omp single
+	{
+		for(size_t i = 1; i < partition_offsets.size(); i++) {
+			partition_offsets[i] += partition_offsets[i - 1];
+		}
+	}
+	for(int p = 0; p < num_partitions; p++) {
+		histogram[p] = partition_offsets[(size_t)p * num_threads + thread];
+	}
+	#pragma omp for schedule(static)
+	for(int indiv = 0; indiv < popsize; indiv++) {
+		partitioned[histogram[hashes[indiv] >> (64 - partition_bits)]++] = indiv;
+	}
+
+	// Count each partition in a private table, chaining rows which share a full hash
+	#pragma omp for schedule(dynamic)
+	for(int p = 0; p < num_partitions; p++) {
+		int begin = partition_offsets[(size_t)p * num_threads];
+		int end = partition_offsets[(size_t)(p + 1) * num_threads];
+		std::vector<ConfigEntry>& entries = entries_by_partition[p];
+		std::unordered_map<uint64_t,int> first_entry;
+		first_entry.reserve((end - begin) / 2 + 1);
+
+		for(int i = begin; i < end; i++) {
+			int indiv = partitioned[i];
+			const int* row = population_traits + (size_t)indiv * numloci;
+			auto found = first_entry.find(hashes[indiv]);
+			int e = (found == first_entry.end()) ? -1 : found->second;
+			while(e >= 0 && memcmp(population_traits + (size_t)entries[e].row * numloci, row, numloci * sizeof(int)) != 0) {
+				e = entries[e].next;
+			}
+			if(e >= 0) {
+				++entries[e].count;
+			}
+			else {
+				int head = (found == first_entry.end()) ? -1 : found->second;
+				entries.push_back(ConfigEntry{indiv, 1, head});
+				first_entry[hashes[indiv]] = entries.size() - 1;
+			}
+		}
+	}
+} // end pragma omp parallel
+
+	std::vector<std::pair<int,int>> count_row;
+	for(int p = 0; p < num_partitions; p++) {
+		for(auto it = entries_by_partition[p].begin(); it != entries_by_partition[p].end(); ++it) {
+			count_row.push_back(std::make_pair(it->count, it->row));
 		}
+	}
+	std::sort(count_row.begin(), count_row.end(), std::greater<std::pair<int,int>>());
 
+	std::shared_ptr<ConfigurationFrequencies> cf(new ConfigurationFrequencies(numloci, count_row.size()));
+	for(size_t c = 0; c < count_row.size(); c++) {
+		cf->counts[c] = count_row[c].first;
+		memcpy(cf->configurations + c * numloci, population_traits + (size_t)count_row[c].second * numloci, numloci * sizeof(int));
 	}
+
+	FREE(hashes);
+	FREE(partitioned);
+	timer.end("population::tabulate_configurations");
+	return cf;
 }
 
 
+double Population::estimate_num_configurations(int precision) {
+	timer.start("population::estimate_num_configurations");
+	int num_threads = MAX_THREADS();
+	std::vector<HyperLogLog> sketches(num_threads, HyperLogLog(precision));
+
+#pragma omp parallel 
+{
+	HyperLogLog& mine = sketches[THREAD_NUM()];
+	int indiv;
+	#pragma omp for private(indiv)
+	for(indiv = 0; indiv < popsize; indiv++) {
+		mine.add(hash_configuration(population_traits + (size_t)indiv * numloci, numloci));
+	}
 }
 
+	for(int t = 1; t < num_threads; t++) {
+		sketches[0].merge(sketches[t]);
+	}
+	double estimate = sketches[0].estimate();
+	timer.end("population::estimate_num_configurations");
+	return estimate;
+}
 
-void Population::step_wfia() {
-	// Prepare by copying current state to previous state, before doing transmission 
-	// algorithm
-	swap_population_arrays();
 
-	generate_uniform_int(0, popsize, popsize, indiv_to_copy);
+std::vector<std::shared_ptr<ClassFrequencies>> Population::tabulate_classes(const std::vector<std::shared_ptr<Classification>>& classifications) {
+	timer.start("population::tabulate_classes");
+	int num_cls = classifications.size();
 
-	// Wright-Fisher dynamics - in order to optimize performance, first we do all the copying so that
-	// most of the copies will be vectorized and broken into work units.  Then, we come back for a small
-	// number of individuals and give them mutated traits.  
+	// classifications with few enough classes are counted in per-thread buffers; larger ones directly into
+	// the shared result with atomic increments, to keep thread buffers small
+	const int max_private_classes = 1 << 16;
+	const int classify_block = 256;
+
+	std::vector<std::shared_ptr<ClassFrequencies>> results;
+	for(int c = 0; c < num_cls; c++) {
+		results.push_back(std::make_shared<ClassFrequencies>(numloci, classifications[c]->max_modes, classifications[c]->num_classes));
+	}
 
 #pragma omp parallel 
 {
+	std::vector<std::vector<int>> local_modes(num_cls);
+	std::vector<std::vector<int>> local_classes(num_cls);
+	for(int c = 0; c < num_cls; c++) {
+		local_modes[c].assign(numloci * classifications[c]->max_modes, 0);
+		if(classifications[c]->num_classes <= max_private_classes) {
+			local_classes[c].assign(classifications[c]->num_classes, 0);
+		}
+	}
+
+	// individuals are classified a block at a time, one locus across the whole block:  the table lookups of 
+	// a locus are then a vectorizable gather, and the block's rows stay in cache between loci
+	int block_modes[classify_block];
+	int block_classes[classify_block];
+
+	int start;
+	#pragma omp for private(start) schedule(static)
+	for(start = 0; start < popsize; start += classify_block) {
+		int count = std::min(classify_block, popsize - start);
+		const int* rows = population_traits + (size_t)start * numloci;
+
+		for(int c = 0; c < num_cls; c++) {
+			const Classification& cls = *classifications[c];
+			int* modes = local_modes[c].data();
+			memset(block_classes, 0, count * sizeof(int));
+
+			for(int locus = 0; locus < numloci; locus++) {
+				const int* table = cls.tables[locus].data();
+				int last = cls.tables[locus].size() - 1;
+				int place = cls.radix[locus];
+
+				#pragma omp simd
+				for(int i = 0; i < count; i++) {
+					int trait = rows[(size_t)i * numloci + locus];
+					int m = table[(trait < last) ? trait : last];
+					block_modes[i] = m;
+					block_classes[i] += m * place;
+				}
+
+				int* locus_modes = modes + locus * cls.max_modes;
+				for(int i = 0; i < count; i++) {
+					++locus_modes[block_modes[i]];
+				}
+			}
+
+			if(cls.num_classes == 0) continue;
+			if(!local_classes[c].empty()) {
+				int* classes = local_classes[c].data();
+				for(int i = 0; i < count; i++) {
+					++classes[block_classes[i]];
+				}
+			}
+			else {
+				for(int i = 0; i < count; i++) {
+					#pragma omp atomic
+					++results[c]->class_counts[block_classes[i]];
+				}
+			}
+		}
+	}
+
+	#pragma omp critical
+	{
+		for(int c = 0; c < num_cls; c++) {
+			for(size_t i = 0; i < local_modes[c].size(); i++) {
+				results[c]->mode_counts[i] += local_modes[c][i];
+			}
+			for(size_t i = 0; i < local_classes[c].size(); i++) {
+				results[c]->class_counts[i] += local_classes[c][i];
+			}
+		}
+	}
+}
+
+	timer.end("population::tabulate_classes");
+	return results;
+}
+
+
+std::shared_ptr<CompactedTraits> Population::compact_traits(int sample_size, bool with_replacement) {
+	timer.start("population::compact_traits");
+	std::vector<int> sample;
+	if(sample_size > 0) {
+		draw_sample_individuals(with_replacement ? sample_size : std::min(sample_size, popsize), with_replacement, sample);
+	}
+	int n = (sample_size > 0) ? (int)sample.size() : popsize;
+	std::shared_ptr<CompactedTraits> ct(new CompactedTraits(numloci, n));
+
+	#pragma omp parallel for schedule(dynamic)
+	for(int locus = 0; locus < numloci; locus++) {
+		std::unordered_map<int, int> compact_id;
+		compact_id.reserve(std::min(n, next_trait[locus]));
+		std::vector<int>& column = ct->columns[locus];
+		column.resize(n);
+		compact_locus(population_traits, numloci, locus, (sample_size > 0) ? sample.data() : nullptr, 0, n, compact_id, ct->trait_ids[locus], column.data());
+	}
+
+	timer.end("population::compact_traits");
+	return ct;
+}
+
+
+std::shared_ptr<TraitFrequencies> Population::tabulate_sample_trait_counts(int sample_size, bool with_replacement) {
+	std::vector<int> sizes(1, sample_size);
+	return tabulate_sample_trait_counts(sizes, with_replacement)[0];
+}
+
+
+
+
+
+
+void Population::set_accumulator(std::shared_ptr<AssemblageAccumulator> acc) {
+	this->accumulator = acc;
+}
+
+
+void Population::set_trait_registry(std::shared_ptr<TraitRegistry> reg) {
+	// detach any previous registry first, so the tabulation below does not update it
+	this->registry.reset();
+	if(reg) {
+		reg->register_present(tabulate_trait_counts(), generation);
+	}
+	this->registry = reg;
+}
+
+
+void Population::copy_parent_traits() {
+	// When an accumulator is attached, each thread also counts the rows it has just copied into its own
+	// counters in the accumulator, while the row is still in cache.  
+	TraitCounter* acc_counts = nullptr;
+
+#pragma omp parallel firstprivate(acc_counts)
+{
+	if(accumulator) {
+		#pragma omp single
+		accumulator->reserve_threads(NUM_THREADS());
+		acc_counts = accumulator->thread_counts_for(THREAD_NUM());
+	}
+
 	int indiv;
 	#pragma omp for private(indiv)
 	for(indiv = 0; indiv < popsize; indiv++) {
@@ -184,23 +715,137 @@ void Population::step_wfia() {
 			population_traits[indiv * numloci + locus] = prev_population_traits[tocopy * numloci + locus];
 		}
 
+		if(acc_counts) {
+			for(int locus = 0; locus < numloci; locus++) {
+				acc_counts[locus].add(population_traits[indiv * numloci + locus], 1);
+			}
+		}
 	}
 }
+}
+
+
+bool Population::set_network(std::shared_ptr<Network> net) {
+	if(net && net->num_nodes != popsize) {
+		clog->error("network has {} nodes, but the population has {} individuals", net->num_nodes, popsize);
+		return false;
+	}
+	if(network && network->is_reordered()) {
+		permute_individuals(network->internal_ids);
+	}
+	this->network = net;
+	if(network && network->is_reordered()) {
+		permute_individuals(network->external_ids);
+	}
+	return true;
+}
+
+
+void Population::permute_individuals(const std::vector<int>& from) {
+	// gathers individual from[i] into position i of the previous generation's array, which is free between 
+	// steps, and swaps it in
+	int* dst = prev_population_traits;
+	int* src = population_traits;
+	#pragma omp parallel for schedule(static)
+	for(int indiv = 0; indiv < popsize; indiv++) {
+		size_t row = (size_t)from[indiv] * numloci;
+		for(int locus = 0; locus < numloci; locus++) {
+			dst[(size_t)indiv * numloci + locus] = src[row + locus];
+		}
+	}
+	prev_population_traits = src;
+	population_traits = dst;
+}
+
+
+void Population::copy_external_order(int* dst) {
+	int* src = population_traits;
+	if(network && network->is_reordered()) {
+		const std::vector<int>& internal = network->internal_ids;
+		#pragma omp parallel for schedule(static)
+		for(int indiv = 0; indiv < popsize; indiv++) {
+			size_t from = (size_t)internal[indiv] * numloci;
+			for(int locus = 0; locus < numloci; locus++) {
+				dst[(size_t)indiv * numloci + locus] = src[from + locus];
+			}
+		}
+		return;
+	}
+
+	size_t cells = (size_t)popsize * numloci;
+	#pragma omp parallel for simd schedule(static)
+	for(size_t i = 0; i < cells; i++) {
+		dst[i] = src[i];
+	}
+}
+
+
+void Population::draw_parents() {
+	if(network) {
+		network->sample_neighbors(indiv_to_copy, mt());
+	}
+	else {
+		generate_uniform_int(0, popsize, popsize, indiv_to_copy, mt());
+	}
+}
+
 
-	// Now, we create innovations given the innovation rate, randomly throughout the population
+void Population::step_basicwf() {
+	// Prepare by copying current state to previous state, before doing transmission 
+	// algorithm
+	swap_population_arrays();
+	++generation;
+
+	draw_parents();
+
+	// Basic Wright-Fisher dynamics without innovation
+	copy_parent_traits();
+
+	if(accumulator) {
+		accumulator->end_generation();
+	}
+}
+
+
+void Population::step_wfia() {
+	// Prepare by copying current state to previous state, before doing transmission 
+	// algorithm
+	swap_population_arrays();
+	++generation;
+
+	draw_parents();
+
+	// The number of innovations is drawn before copying, which fixes the order of draws from the engine
 	int num_mutations = poisson_dist(this->mt);
 	//SPDLOG_TRACE(clog,"WFIA: num mutations this step: {}", num_mutations);
 
+	// Wright-Fisher dynamics - in order to optimize performance, first we do all the copying so that
+	// most of the copies will be vectorized and broken into work units.  Then, we come back for a small
+	// number of individuals and give them mutated traits.  
+	copy_parent_traits();
+
+	// Now, we create innovations given the innovation rate, randomly throughout the population.  If
+	// the copied traits have been counted, each innovation moves one count from the replaced trait to the new one.
+	TraitCounter* acc_counts = accumulator ? accumulator->thread_counts_for(0) : nullptr;
+
 	for(int j = 0; j < num_mutations; j++) {
 		int indiv_to_mutate = uniform_pop(this->mt);
 		int locus_to_mutate = uniform_locus(this->mt);
 		int new_trait = next_trait[locus_to_mutate];
 		++next_trait[locus_to_mutate];
+		if(registry) {
+			registry->record_origin(locus_to_mutate, new_trait, generation);
+		}
+		if(acc_counts) {
+			acc_counts[locus_to_mutate].add(population_traits[indiv_to_mutate * numloci + locus_to_mutate], -1);
+			acc_counts[locus_to_mutate].add(new_trait, 1);
+		}
 		population_traits[indiv_to_mutate * numloci + locus_to_mutate] = new_trait;
 	}
 
-
-
+	if(accumulator) {
+		accumulator->end_generation();
+	}
 }
 
 
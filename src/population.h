@@ -1,8 +1,19 @@
 #pragma once
 
 #include <random>
+#include <vector>
+#include <memory>
 #include "defines.h"
 #include "statistics.h"
+#include "assemblage.h"
+#include "lifetimes.h"
+#include "topk.h"
+#include "configurations.h"
+#include "classification.h"
+#include "association.h"
+#include "checkpoint.h"
+#include "statedump.h"
+#include "network.h"
 
 
 
@@ -10,6 +21,8 @@
 
 namespace CTModels {
 
+enum ruletype { BASICWF, WFIA };
+
 /** \class Population 
 *
 * Represents a population of individuals, which carry cultural traits along one or more dimensions
@@ -25,19 +38,36 @@ private:
 	int numloci;
 	int inittraits;
 	double innovation_rate;
+	int generation = 0;
+	bool seeded = false;
+	uint64_t seed_value = 0;
 	std::uniform_int_distribution<int> uniform_pop;
 	std::uniform_int_distribution<int> uniform_locus;
 	std::poisson_distribution<int> poisson_dist;
 	std::mt19937_64 mt;
+	std::mt19937_64 sample_mt;
 	std::vector<int> next_trait;
-	int* population_traits;
-	int* prev_population_traits;
+	int* population_traits = nullptr;
+	int* prev_population_traits = nullptr;
 	int* locus_counts;
-	int* indiv_to_copy;
+	int* indiv_to_copy = nullptr;
+	size_t trait_capacity = 0;
+	int indiv_capacity = 0;
 	int trait_digits_printing = 0;
 	int pop_digits_printing = 0;
-
+	std::shared_ptr<AssemblageAccumulator> accumulator;
+	std::shared_ptr<TraitRegistry> registry;
+	std::shared_ptr<MappedCheckpoint> checkpoint;
+	std::shared_ptr<Network> network;
+
+	void setup_distributions();
+	void draw_parents();
+	void permute_individuals(const std::vector<int>& from);
+	void copy_external_order(int* dst);
+	void reserve_arrays();
 	void swap_population_arrays();
+	void copy_parent_traits();
+	void draw_sample_individuals(int sample_size, bool with_replacement, std::vector<int>& sample);
 
 
 public:
@@ -56,6 +86,40 @@ public:
 	*/
 	void initialize();
 
+	/**
+	* Copies the population state into the writer's snapshot buffer and starts writing it to disk in the
+	* background.  Only the copy holds up the simulation.  The rule the population is being stepped with is 
+	* recorded, so that a restart can refuse to continue under a different one.
+	*/
+	void write_checkpoint(CheckpointWriter& writer, ruletype rule);
+
+	/**
+	* Gives the population new parameters and initializes it afresh, as a new replicate, reusing its trait
+	* buffers whenever they are large enough.  Any attached accumulator or trait registry is detached.
+	*/
+	void reset(int p, int n, int i, double r);
+
+	/**
+	* Seeds the random number engine used by the next initialize() or reset(), making the run reproducible 
+	* for a given seed.  Without a seed, each initialization draws one from std::random_device.
+	*/
+	void set_seed(uint64_t seed) { seeded = true; seed_value = seed; }
+
+	/**
+	* Constructs a population from a checkpoint file written by write_checkpoint(), instead of calling 
+	* initialize().  Parameters, generation, innovation counters and random engine state come from the file,
+	* and the trait matrix is memory mapped rather than read, so restarting a large population costs only 
+	* the page faults it actually touches.  The copying rule recorded in the checkpoint is returned in rule.
+	* Returns nullptr if the file cannot be used.
+	*/
+	static Population* from_checkpoint(const std::string& path, ruletype& rule);
+
+	/**
+	* Hands a copy of the current trait matrix to a state dump writer, which compresses and writes it in the
+	* background.  A compact binary replacement for dbg_log_population() when many states are needed.
+	*/
+	void dump_state(StateDumpWriter& writer);
+
 	/**
 	* Tabulates frequencies of traits in the current population of individuals, separately for each locus/dimension.
 	* Returns the counts in a TraitFrequencies object, wrapped in a smart pointer which reclaims the memory when
@@ -63,6 +127,93 @@ public:
 	*/
 	std::shared_ptr<TraitFrequencies> tabulate_trait_counts();
 
+	/**
+	* Tabulates trait frequencies in a random sample of individuals rather than the whole population, at
+	* a cost proportional to the sample size.  Several sample sizes are served by one nested draw:  the 
+	* individuals are drawn once, in random order, for the largest size, and each smaller sample is a 
+	* prefix of that draw.  Returns one TraitFrequencies per requested size, in the order requested, with
+	* compact columns (see TraitFrequencies) so that its size follows the sample's distinct traits and not 
+	* the population's innovation history.  Samples drawn without replacement are capped at popsize.  Draws 
+	* come from a sampling engine of their own, so taking samples does not change the simulation's course.
+	*/
+	std::vector<std::shared_ptr<TraitFrequencies>> tabulate_sample_trait_counts(const std::vector<int>& sample_sizes, bool with_replacement);
+
+	/**
+	* Finds approximately the k most frequent traits at each locus directly from the population, without 
+	* building dense count arrays.  Each thread summarizes its share of individuals with a Space-Saving sketch 
+	* per locus, monitoring sketch_capacity traits, and the sketches are merged at the end.  Counts are exact
+	* whenever a locus has no more than sketch_capacity distinct traits.  
+	*/
+	std::shared_ptr<TopTraits> tabulate_top_traits(int k, int sketch_capacity);
+
+	/**
+	* Counts the distinct multi-locus trait configurations ("classes") carried by individuals, exactly.  Each 
+	* row of traits is hashed in a vectorized pass, rows are radix partitioned on their hash across threads, 
+	* and each partition is then counted in its own small hash table by a single thread, with colliding rows 
+	* told apart by comparing their traits.  
+	*/
+	std::shared_ptr<ConfigurationFrequencies> tabulate_configurations();
+
+	/**
+	* Estimates the number of distinct multi-locus trait configurations with a HyperLogLog sketch of
+	* 2^precision registers per thread, in a single pass and constant memory.  
+	*/
+	double estimate_num_configurations(int precision);
+
+	/**
+	* Maps every individual through one or more paradigmatic classifications, tabulating the frequencies of 
+	* modes at each locus and of classes (combinations of modes) for each classification.  All classifications
+	* are evaluated in the same sweep over the population, with per-thread counts merged at the end.  Each
+	* thread classifies blocks of individuals one locus at a time, so mode lookups are vectorized gathers.  
+	*/
+	std::vector<std::shared_ptr<ClassFrequencies>> tabulate_classes(const std::vector<std::shared_ptr<Classification>>& classifications);
+
+	/**
+	* Copies the traits of the population, or of a random sample of sample_size individuals if sample_size is
+	* positive, into column-major form with trait IDs renumbered densely at each locus.  Loci are compacted in
+	* parallel, at a cost that follows the individuals copied rather than the traits ever introduced.  The result feeds pairwise computations such as calculate_locus_associations().
+	*/
+	std::shared_ptr<CompactedTraits> compact_traits(int sample_size, bool with_replacement);
+
+	/**
+	* Convenience form of tabulate_sample_trait_counts() for a single sample size.
+	*/
+	std::shared_ptr<TraitFrequencies> tabulate_sample_trait_counts(int sample_size, bool with_replacement);
+
+
+	/**
+	* Attaches an accumulator which receives the trait counts of every subsequent generation.  Counting is 
+	* fused into the transmission copy of step_basicwf() and step_wfia(), each thread counting the rows it 
+	* has just written, so time-averaged assemblages cost no extra pass over the population.  Pass an empty
+	* pointer to detach.
+	*/
+	void set_accumulator(std::shared_ptr<AssemblageAccumulator> acc);
+
+	/**
+	* Attaches a registry which tracks the origin and extinction of traits from now on.  Traits currently
+	* present are registered as initial traits; every later innovation is recorded as it is handed out, and
+	* each call to tabulate_trait_counts() updates the registry.  Pass an empty pointer to detach.
+	*/
+	void set_trait_registry(std::shared_ptr<TraitRegistry> reg);
+
+	/**
+	* Places the population on a network whose nodes are its individuals.  From now on each individual copies
+	* a random neighbor instead of a random member of the whole population; innovation is unchanged.  Returns
+	* false, leaving the population panmictic, if the network has a different number of nodes.  Pass an empty 
+	* pointer to detach.  If the network has been renumbered, individuals are moved into its internal order,
+	* and moved back when it is detached; checkpoints and state dumps are always written in external order.
+	*/
+	bool set_network(std::shared_ptr<Network> net);
+
+	/**
+	* Returns the number of time steps taken since initialization.
+	*/
+	int get_generation() { return generation; }
+
+	int get_popsize() { return popsize; }
+	int get_numloci() { return numloci; }
+	int get_inittraits() { return inittraits; }
+	double get_innovation_rate() { return innovation_rate; }
 
 	/**
 	* Advances the simulation by one time step, implementing cultural transmission within the population.  
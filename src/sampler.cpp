@@ -0,0 +1,179 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+#include "sampler.h"
+#include "population.h"
+#include "statistics.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+void SampleRecord::fill(int generation, std::shared_ptr<TraitStatistics> ts, std::shared_ptr<TraitFrequencies> tf) {
+	this->generation = generation;
+	this->numloci = ts->numloci;
+	richness.assign(ts->trait_richness_by_locus, ts->trait_richness_by_locus + numloci);
+	entropy.assign(ts->shannon_entropy_by_locus, ts->shannon_entropy_by_locus + numloci);
+	simpson.assign(ts->simpson_diversity_by_locus, ts->simpson_diversity_by_locus + numloci);
+	evenness.assign(ts->evenness_by_locus, ts->evenness_by_locus + numloci);
+	dominant_freq.assign(ts->dominant_freq_by_locus, ts->dominant_freq_by_locus + numloci);
+
+	has_counts = (bool)tf;
+	if(tf) {
+		max_num_traits = tf->max_num_traits;
+		trait_counts.assign(tf->trait_counts, tf->trait_counts + (size_t)tf->numloci * tf->max_num_traits);
+		trait_ids.assign(tf->trait_ids.begin(), tf->trait_ids.end());
+	}
+	else {
+		max_num_traits = 0;
+		trait_counts.clear();
+		trait_ids.clear();
+	}
+}
+
+
+
+SampleRingBuffer::SampleRingBuffer(size_t capacity) : head(0), tail(0) {
+	size_t size = 1;
+	while(size < capacity) size <<= 1;
+	slots.resize(size);
+	mask = size - 1;
+}
+
+
+SampleRecord* SampleRingBuffer::claim() {
+	size_t h = head.load(std::memory_order_relaxed);
+	if(h - tail.load(std::memory_order_acquire) > mask) return nullptr;
+	return &slots[h & mask];
+}
+
+
+void SampleRingBuffer::publish() {
+	head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+SampleRecord* SampleRingBuffer::front() {
+	size_t t = tail.load(std::memory_order_relaxed);
+	if(t == head.load(std::memory_order_acquire)) return nullptr;
+	return &slots[t & mask];
+}
+
+
+void SampleRingBuffer::release() {
+	tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+
+TextSampleSink::TextSampleSink(const std::string& path) {
+	out = fopen(path.c_str(), "w");
+	if(out == NULL) {
+		clog->error("cannot open time series output {}", path);
+		return;
+	}
+	fprintf(out, "generation\tlocus\trichness\tentropy\tsimpson\tevenness\tdominant_freq\tcounts\n");
+}
+
+
+TextSampleSink::~TextSampleSink() {
+	if(out != NULL) fclose(out);
+}
+
+
+void TextSampleSink::write(const SampleRecord& record) {
+	if(out == NULL) return;
+	for(int locus = 0; locus < record.numloci; locus++) {
+		fprintf(out, "%d\t%d\t%d\t%.6f\t%.6f\t%.6f\t%.6f\t", record.generation, locus, record.richness[locus],
+			record.entropy[locus], record.simpson[locus], record.evenness[locus], record.dominant_freq[locus]);
+		if(record.has_counts) {
+			const int* row = record.trait_counts.data() + (size_t)locus * record.max_num_traits;
+			for(int column = 0; column < record.max_num_traits; column++) {
+				if(row[column] > 0) fprintf(out, "%d:%d ", record.trait_id(locus, column), row[column]);
+			}
+		}
+		fputc('\n', out);
+	}
+}
+
+
+void TextSampleSink::flush() {
+	if(out != NULL) fflush(out);
+}
+
+
+
+TimeSeriesSampler::TimeSeriesSampler(std::shared_ptr<SampleSink> sink, int interval, int sample_size, bool include_counts, size_t capacity)
+	: interval(interval), sample_size(sample_size), include_counts(include_counts), ring(capacity), sink(sink), stopping(false), dropped(0) {
+	writer = std::thread(&TimeSeriesSampler::drain, this);
+}
+
+
+TimeSeriesSampler::~TimeSeriesSampler() {
+	finish();
+}
+
+
+void TimeSeriesSampler::drain() {
+	// Poll with a short sleep when idle rather than waiting on a condition variable, so the producer 
+	// never has to touch a mutex to wake us
+	while(true) {
+		SampleRecord* rec = ring.front();
+		if(rec != nullptr) {
+			sink->write(*rec);
+			ring.release();
+			continue;
+		}
+		if(stopping.load(std::memory_order_acquire)) {
+			if(ring.front() == nullptr) break;
+			continue;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	sink->flush();
+}
+
+
+void TimeSeriesSampler::record(int generation, std::shared_ptr<TraitStatistics> ts, std::shared_ptr<TraitFrequencies> tf) {
+	SampleRecord* rec = ring.claim();
+	if(rec == nullptr) {
+		++dropped;
+		return;
+	}
+	rec->fill(generation, ts, include_counts ? tf : std::shared_ptr<TraitFrequencies>());
+	ring.publish();
+}
+
+
+void TimeSeriesSampler::sample(Population& pop) {
+	if(pop.get_generation() % interval != 0) return;
+	sample_now(pop);
+}
+
+
+void TimeSeriesSampler::sample_now(Population& pop) {
+	timer.start("sampler::sample");
+	auto tf = (sample_size > 0) ? pop.tabulate_sample_trait_counts(sample_size, false) : pop.tabulate_trait_counts();
+	record(pop.get_generation(), calculate_trait_statistics(tf), tf);
+	timer.end("sampler::sample");
+}
+
+
+void TimeSeriesSampler::finish() {
+	if(writer.joinable()) {
+		stopping.store(true, std::memory_order_release);
+		writer.join();
+		if(dropped > 0) {
+			clog->warn("time series writer fell behind, {} samples were dropped", dropped);
+		}
+	}
+}
+
+
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include "defines.h"
+#include "statistics.h"
+
+
+namespace CTModels {
+
+class Population;
+
+/** \class SampleRecord
+*
+* One time series sample:  the diversity statistics of every locus at a generation, and optionally the 
+* full trait counts.  Records live in the slots of a SampleRingBuffer and are overwritten in place, so their 
+* vectors only allocate when a sample is larger than any before it in the same slot.  Counts are addressed
+* as trait_counts[locus * max_num_traits + column], and trait_ids gives the trait of each column when 
+* the counts came from a sample with compact columns (see TraitFrequencies); it is empty otherwise.
+*/
+
+class SampleRecord {
+public:
+	int generation;
+	int numloci;
+	int max_num_traits;
+	bool has_counts;
+	std::vector<int> richness;
+	std::vector<double> entropy;
+	std::vector<double> simpson;
+	std::vector<double> evenness;
+	std::vector<double> dominant_freq;
+	std::vector<int> trait_counts;
+	std::vector<int> trait_ids;
+
+	int trait_id(int locus, int column) const {
+		return trait_ids.empty() ? column : trait_ids[(size_t)locus * max_num_traits + column];
+	}
+
+	/**
+	* Copies statistics, and counts if tf is given, into this record.
+	*/
+	void fill(int generation, std::shared_ptr<TraitStatistics> ts, std::shared_ptr<TraitFrequencies> tf);
+};
+
+
+/** \class SampleRingBuffer
+*
+* Bounded single-producer, single-consumer ring of SampleRecord slots.  The producer claims the slot at head,
+* fills it and publishes it by advancing head; the consumer reads the slot at tail and releases it by advancing
+* tail.  Each index is written by only one side, so acquire/release ordering on the two atomics is all the 
+* synchronization needed, and neither side ever takes a lock.  Capacity is rounded up to a power of two.
+*/
+
+class SampleRingBuffer {
+private:
+	std::vector<SampleRecord> slots;
+	size_t mask;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+public:
+	SampleRingBuffer(size_t capacity);
+
+	/** Returns the next free slot for the producer, or nullptr if the ring is full. */
+	SampleRecord* claim();
+	void publish();
+
+	/** Returns the oldest published slot for the consumer, or nullptr if the ring is empty. */
+	SampleRecord* front();
+	void release();
+};
+
+
+/** \class SampleSink
+*
+* Destination for time series samples, called only from the sampler's writer thread.  
+*/
+
+class SampleSink {
+public:
+	virtual ~SampleSink() {}
+	virtual void write(const SampleRecord& record) = 0;
+	virtual void flush() {}
+};
+
+
+/** \class TextSampleSink
+*
+* Writes samples as tab separated text, one line per locus per sample:  generation, locus, richness, 
+* entropy, simpson, evenness, dominant frequency, followed by trait:count pairs for nonzero counts when 
+* counts were sampled.
+*/
+
+class TextSampleSink : public SampleSink {
+private:
+	FILE* out;
+
+public:
+	TextSampleSink(const std::string& path);
+	~TextSampleSink();
+	bool is_open() { return out != NULL; }
+	void write(const SampleRecord& record);
+	void flush();
+};
+
+
+/** \class TimeSeriesSampler
+*
+* Records a trajectory of statistics during a run.  Every interval generations, sample() tabulates the 
+* population (or a random sample of sample_size individuals), computes its TraitStatistics, and copies them 
+* into the ring buffer.  A background writer thread drains the ring into a SampleSink, so the simulation 
+* never waits on I/O; if the writer falls so far behind that the ring fills, samples are dropped and counted 
+* rather than blocking the simulation.  finish() drains the remaining samples and stops the writer.
+*/
+
+class TimeSeriesSampler {
+private:
+	int interval;
+	int sample_size;
+	bool include_counts;
+	SampleRingBuffer ring;
+	std::shared_ptr<SampleSink> sink;
+	std::thread writer;
+	std::atomic<bool> stopping;
+	long dropped;
+
+	void drain();
+
+public:
+	TimeSeriesSampler(std::shared_ptr<SampleSink> sink, int interval, int sample_size, bool include_counts, size_t capacity);
+	~TimeSeriesSampler();
+
+	/**
+	* Takes a sample if the population's generation falls on the sampling interval.  
+	*/
+	void sample(Population& pop);
+
+	/**
+	* Takes a sample of the population's current generation, regardless of interval, tabulated as sample() does.
+	*/
+	void sample_now(Population& pop);
+
+	/**
+	* Records an already computed sample, regardless of interval.
+	*/
+	void record(int generation, std::shared_ptr<TraitStatistics> ts, std::shared_ptr<TraitFrequencies> tf);
+
+	void finish();
+	long get_dropped() { return dropped; }
+};
+
+};
@@ -0,0 +1,190 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <spdlog/spdlog.h>
+
+#include "scheduler.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+// trait cells (ints) per thread below which splitting a step across more threads stops paying off;
+// 64K cells is 256KB of each trait array, about one core's share of cache
+static const size_t CELLS_PER_THREAD = 1 << 16;
+
+
+WorkStealingQueues::WorkStealingQueues(int workers) {
+	for(int w = 0; w < workers; w++) {
+		lanes.push_back(std::unique_ptr<Lane>(new Lane()));
+	}
+}
+
+
+void WorkStealingQueues::push(int worker, int job) {
+	Lane& lane = *lanes[worker];
+	std::lock_guard<std::mutex> guard(lane.lock);
+	lane.jobs.push_back(job);
+}
+
+
+bool WorkStealingQueues::pop(int worker, int& job) {
+	int workers = lanes.size();
+	{
+		Lane& own = *lanes[worker];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if(!own.jobs.empty()) {
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+	for(int i = 1; i < workers; i++) {
+		Lane& victim = *lanes[(worker + i) % workers];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if(!victim.jobs.empty()) {
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static void step_population(Population& pop, ruletype rule) {
+	switch(rule) {
+		case BASICWF :
+			pop.step_basicwf();
+			break;
+		case WFIA :
+			pop.step_wfia();
+			break;
+	}
+}
+
+
+static void set_threads(int threads) {
+#if defined(_OPENMP)
+	omp_set_num_threads(threads);
+#endif
+}
+
+
+ReplicateSchedule plan_replicate_schedule(const RunParameters& params, int replicates, int max_threads, 
+	size_t memory_budget, int calibration_generations) {
+	ReplicateSchedule sched;
+	size_t cells = (size_t)params.popsize * params.numloci;
+	sched.bytes_per_replicate = 2 * cells * sizeof(int) + params.popsize * sizeof(int);
+
+	int memory_limit = max_threads;
+	if(memory_budget > 0) {
+		memory_limit = std::max<size_t>(1, std::min<size_t>(max_threads, memory_budget / sched.bytes_per_replicate));
+	}
+	int replicate_limit = std::max(1, std::min(replicates, max_threads));
+
+	if(calibration_generations > 0) {
+		Population probe(params.popsize, params.numloci, params.inittraits, params.innovation_rate);
+		probe.initialize();
+
+		double best_throughput = 0.0;
+		double best_step = 0.0;
+		sched.threads_per_replicate = 1;
+		sched.max_useful_threads = 1;
+		for(int t = 1; t <= max_threads; t = (t < max_threads && 2 * t > max_threads) ? max_threads : 2 * t) {
+			set_threads(t);
+			step_population(probe, params.rule);
+			auto start = std::chrono::steady_clock::now();
+			for(int g = 0; g < calibration_generations; g++) {
+				step_population(probe, params.rule);
+			}
+			double per_step = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / calibration_generations;
+			int concurrent = std::min(std::min(max_threads / t, memory_limit), replicate_limit);
+			double throughput = concurrent / per_step;
+			SPDLOG_DEBUG(clog, "calibration: {} threads, {:.6f} s/step, {} concurrent replicates", t, per_step, concurrent);
+
+			if(throughput > best_throughput) {
+				best_throughput = throughput;
+				sched.threads_per_replicate = t;
+			}
+			if(best_step == 0.0 || per_step < best_step) {
+				best_step = per_step;
+				sched.max_useful_threads = t;
+			}
+			if(t == max_threads) break;
+		}
+		set_threads(max_threads);
+	}
+	else {
+		int useful = std::max<size_t>(1, std::min<size_t>(max_threads, cells / CELLS_PER_THREAD));
+		sched.threads_per_replicate = useful;
+		sched.max_useful_threads = useful;
+	}
+
+	sched.max_useful_threads = std::max(sched.max_useful_threads, sched.threads_per_replicate);
+	sched.concurrent = std::max(1, std::min(std::min(max_threads / sched.threads_per_replicate, memory_limit), replicate_limit));
+	// with fewer replicates than slots, give the spare threads to the replicates that do run
+	sched.threads_per_replicate = std::max(sched.threads_per_replicate, 
+		std::min(sched.max_useful_threads, max_threads / sched.concurrent));
+	return sched;
+}
+
+
+long run_batch_adaptive(const std::vector<RunParameters>& configs, int replicates, BatchOutput& output, 
+	size_t memory_budget, int calibration_generations) {
+	timer.start("scheduler::run_batch_adaptive");
+	int max_threads = MAX_THREADS();
+	std::atomic<long> runs(0);
+
+#if defined(_OPENMP)
+	int saved_levels = omp_get_max_active_levels();
+	omp_set_max_active_levels(2);
+#endif
+
+	for(size_t c = 0; c < configs.size(); c++) {
+		const RunParameters& params = configs[c];
+		ReplicateSchedule sched = plan_replicate_schedule(params, replicates, max_threads, memory_budget, calibration_generations);
+		SPDLOG_DEBUG(clog, "configuration {}: {} concurrent replicates with {} threads each (at most {}), {} bytes each", 
+			c, sched.concurrent, sched.threads_per_replicate, sched.max_useful_threads, sched.bytes_per_replicate);
+
+		WorkStealingQueues queues(sched.concurrent);
+		for(int rep = 0; rep < replicates; rep++) {
+			queues.push(rep % sched.concurrent, rep);
+		}
+
+		std::atomic<int> active(sched.concurrent);
+		std::atomic<int> allotment(sched.threads_per_replicate);
+
+		#pragma omp parallel num_threads(sched.concurrent)
+		{
+			int worker = THREAD_NUM();
+			Population pop(params.popsize, params.numloci, params.inittraits, params.innovation_rate);
+			int rep;
+			while(queues.pop(worker, rep)) {
+				output.write(params, run_replicate(pop, params, c, rep, &allotment));
+				++runs;
+			}
+
+			// this worker has nothing left to take, so its threads go to the replicates still running
+			int remaining = --active;
+			if(remaining > 0) {
+				allotment.store(std::min(sched.max_useful_threads, max_threads / remaining));
+			}
+		}
+	}
+
+#if defined(_OPENMP)
+	omp_set_max_active_levels(saved_levels);
+#endif
+	output.flush();
+	timer.end("scheduler::run_batch_adaptive");
+	return runs;
+}
+
+
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
+#include "defines.h"
+#include "batch.h"
+
+
+namespace CTModels {
+
+/** \class ReplicateSchedule
+*
+* How a configuration's replicates share the machine:  concurrent replicates run at once, each starting
+* with threads_per_replicate OpenMP threads for its steps, and never widened beyond max_useful_threads as
+* other replicates finish.  
+*/
+
+class ReplicateSchedule {
+public:
+	int concurrent;
+	int threads_per_replicate;
+	int max_useful_threads;
+	size_t bytes_per_replicate;
+};
+
+
+/** \class WorkStealingQueues
+*
+* One double-ended job queue per worker.  A worker takes jobs from the back of its own queue and, once 
+* that is empty, steals from the front of the others', so work dealt out unevenly, or jobs that turn out 
+* longer than expected, are rebalanced without a central queue every worker contends on.  Jobs are indices
+* into a caller's job list.  
+*/
+
+class WorkStealingQueues {
+private:
+	class Lane {
+	public:
+		std::mutex lock;
+		std::deque<int> jobs;
+	};
+	std::vector<std::unique_ptr<Lane>> lanes;
+
+public:
+	WorkStealingQueues(int workers);
+
+	void push(int worker, int job);
+
+	/**
+	* Takes the next job for worker, stealing if its own queue is empty.  Returns false when every queue is empty.
+	*/
+	bool pop(int worker, int& job);
+};
+
+
+/**
+* Decides how a configuration's replicates should run on max_threads threads without their trait arrays 
+* exceeding memory_budget bytes.  With calibration_generations > 0, a replicate is stepped for that many 
+* generations at 1, 2, 4 ... max_threads threads, and the thread count giving the highest total replicate
+* throughput (concurrent replicates / seconds per step) is chosen.  Otherwise a cost model allots a thread
+* per CELLS_PER_THREAD trait cells, below which an omp parallel region costs more than it saves.  
+*/
+ReplicateSchedule plan_replicate_schedule(const RunParameters& params, int replicates, int max_threads, 
+	size_t memory_budget, int calibration_generations);
+
+/**
+* Runs every configuration's replicates as run_batch() does, but with several replicates in flight at once 
+* as planned by plan_replicate_schedule().  Replicates are dealt out to work-stealing queues, one per 
+* concurrent replicate; as the queues run dry and replicates finish, the threads they release are shared 
+* among the replicates still running.  Requires nested OpenMP parallelism.  Returns the number of replicates run.
+*/
+long run_batch_adaptive(const std::vector<RunParameters>& configs, int replicates, BatchOutput& output, 
+	size_t memory_budget, int calibration_generations);
+
+};
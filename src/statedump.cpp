@@ -0,0 +1,349 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <spdlog/spdlog.h>
+
+#include "statedump.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+	while(v >= 0x80) {
+		out.push_back((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((uint8_t)v);
+}
+
+static bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+	v = 0;
+	for(int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if((b & 0x80) == 0) return true;
+	}
+	return false;
+}
+
+static int bits_needed(uint64_t num_values) {
+	return (num_values <= 1) ? 0 : 64 - CLZ64(num_values - 1);
+}
+
+
+/*
+* Bit packing, least significant bit first, into whole bytes appended to a vector.
+*/
+class BitPacker {
+private:
+	std::vector<uint8_t>& out;
+	uint64_t acc;
+	int nbits;
+
+public:
+	BitPacker(std::vector<uint8_t>& out) : out(out), acc(0), nbits(0) {}
+
+	void put(uint64_t v, int width) {
+		if(width == 0) return;
+		acc |= v << nbits;
+		nbits += width;
+		while(nbits >= 8) {
+			out.push_back((uint8_t)acc);
+			acc >>= 8;
+			nbits -= 8;
+		}
+	}
+
+	void flush() {
+		if(nbits > 0) out.push_back((uint8_t)acc);
+		acc = 0;
+		nbits = 0;
+	}
+};
+
+class BitUnpacker {
+private:
+	const uint8_t*& p;
+	const uint8_t* end;
+	uint64_t acc;
+	int nbits;
+
+public:
+	BitUnpacker(const uint8_t*& p, const uint8_t* end) : p(p), end(end), acc(0), nbits(0) {}
+
+	bool get(int width, uint64_t& v) {
+		if(width == 0) { v = 0; return true; }
+		while(nbits < width) {
+			if(p >= end) return false;
+			acc |= (uint64_t)(*p++) << nbits;
+			nbits += 8;
+		}
+		v = acc & ((1ULL << width) - 1);
+		acc >>= width;
+		nbits -= width;
+		return true;
+	}
+
+	// discards the bits remaining in the current byte
+	void align() { acc = 0; nbits = 0; }
+};
+
+
+
+void encode_state_frame(const int* traits, const int* reference, int popsize, int numloci, std::vector<uint8_t>& out) {
+	std::vector<int> column(popsize);
+	std::vector<int> distinct;
+
+	for(int locus = 0; locus < numloci; locus++) {
+		for(int indiv = 0; indiv < popsize; indiv++) {
+			column[indiv] = traits[indiv * numloci + locus];
+		}
+		distinct = column;
+		std::sort(distinct.begin(), distinct.end());
+		distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+		put_varint(out, distinct.size());
+		int prev = 0;
+		for(auto it = distinct.begin(); it != distinct.end(); ++it) {
+			put_varint(out, (uint64_t)(*it - prev));
+			prev = *it;
+		}
+		int width = bits_needed(distinct.size());
+
+		// a bitmap of changes pays for itself only when fewer than half the individuals changed
+		int num_changed = popsize;
+		if(reference != NULL) {
+			num_changed = 0;
+			for(int indiv = 0; indiv < popsize; indiv++) {
+				num_changed += (column[indiv] != reference[indiv * numloci + locus]);
+			}
+		}
+		bool use_bitmap = reference != NULL && 2 * num_changed < popsize;
+
+		BitPacker bits(out);
+		if(use_bitmap) {
+			out.push_back(STATE_CELLS_CHANGED);
+			for(int indiv = 0; indiv < popsize; indiv++) {
+				bits.put(column[indiv] != reference[indiv * numloci + locus], 1);
+			}
+			bits.flush();
+		}
+		else {
+			out.push_back(STATE_CELLS_ALL);
+		}
+
+		for(int indiv = 0; indiv < popsize; indiv++) {
+			if(use_bitmap && column[indiv] == reference[indiv * numloci + locus]) continue;
+			size_t index = std::lower_bound(distinct.begin(), distinct.end(), column[indiv]) - distinct.begin();
+			bits.put(index, width);
+		}
+		bits.flush();
+	}
+}
+
+
+bool decode_state_frame(const uint8_t* payload, size_t payload_bytes, int popsize, int numloci, int* traits) {
+	const uint8_t* p = payload;
+	const uint8_t* end = payload + payload_bytes;
+	std::vector<int> distinct;
+	std::vector<uint8_t> changed(popsize);
+
+	for(int locus = 0; locus < numloci; locus++) {
+		uint64_t num_distinct, gap;
+		if(!get_varint(p, end, num_distinct) || num_distinct > (uint64_t)popsize) return false;
+		distinct.resize(num_distinct);
+		int prev = 0;
+		for(uint64_t i = 0; i < num_distinct; i++) {
+			if(!get_varint(p, end, gap)) return false;
+			prev += (int)gap;
+			distinct[i] = prev;
+		}
+		int width = bits_needed(num_distinct);
+
+		if(p >= end) return false;
+		uint8_t mode = *p++;
+		BitUnpacker bits(p, end);
+		uint64_t v;
+		if(mode == STATE_CELLS_CHANGED) {
+			for(int indiv = 0; indiv < popsize; indiv++) {
+				if(!bits.get(1, v)) return false;
+				changed[indiv] = (uint8_t)v;
+			}
+			bits.align();
+		}
+		else if(mode != STATE_CELLS_ALL) {
+			return false;
+		}
+
+		for(int indiv = 0; indiv < popsize; indiv++) {
+			if(mode == STATE_CELLS_CHANGED && !changed[indiv]) continue;
+			if(!bits.get(width, v) || v >= num_distinct) return false;
+			traits[indiv * numloci + locus] = distinct[v];
+		}
+		bits.align();
+	}
+	return p == end;
+}
+
+
+
+StateDumpWriter::StateDumpWriter(const std::string& path, int popsize, int numloci, int keyframe_interval, size_t capacity) 
+	: head(0), tail(0), stopping(false), bytes_written(0), frames_written(0) {
+	size_t n = 2;
+	while(n < capacity) n <<= 1;
+	mask = n - 1;
+	cells = (size_t)popsize * numloci;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = STATEDUMP_MAGIC;
+	header.version = 1;
+	header.numloci = numloci;
+	header.popsize = popsize;
+	header.keyframe_interval = (keyframe_interval > 0) ? keyframe_interval : 1;
+
+	out = fopen(path.c_str(), "wb");
+	if(out == NULL) {
+		clog->error("cannot open state dump file {}", path);
+		return;
+	}
+	fwrite(&header, sizeof(header), 1, out);
+	bytes_written = sizeof(header);
+
+	for(size_t i = 0; i < n; i++) {
+		slots.push_back((int*) ALIGNED_MALLOC(cells * sizeof(int)));
+	}
+	slot_generation.resize(n);
+	writer = std::thread(&StateDumpWriter::drain, this);
+}
+
+
+StateDumpWriter::~StateDumpWriter() {
+	finish();
+	for(auto it = slots.begin(); it != slots.end(); ++it) {
+		FREE(*it);
+	}
+}
+
+
+int* StateDumpWriter::claim(int generation) {
+	size_t h = head.load(std::memory_order_relaxed);
+	while(h - tail.load(std::memory_order_acquire) > mask) {
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	slot_generation[h & mask] = generation;
+	return slots[h & mask];
+}
+
+
+void StateDumpWriter::publish() {
+	head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+void StateDumpWriter::drain() {
+	std::vector<uint8_t> payload;
+	const int* reference = NULL;
+	int popsize = (int)header.popsize;
+	int numloci = (int)header.numloci;
+
+	// next is the slot to encode.  The slot before it is kept out of the producer's hands as the reference
+	// for the next delta frame, so tail trails next by one once the first frame is written.
+	size_t next = tail.load(std::memory_order_relaxed);
+	while(true) {
+		if(next == head.load(std::memory_order_acquire)) {
+			if(stopping.load(std::memory_order_acquire) && next == head.load(std::memory_order_acquire)) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		bool key = (frames_written % header.keyframe_interval) == 0;
+		const int* state = slots[next & mask];
+		payload.clear();
+		encode_state_frame(state, key ? NULL : reference, popsize, numloci, payload);
+
+		StateFrameHeader fh;
+		fh.magic = STATEFRAME_MAGIC;
+		fh.flags = key ? STATE_FRAME_KEY : 0;
+		fh.generation = slot_generation[next & mask];
+		fh.payload_bytes = payload.size();
+		fwrite(&fh, sizeof(fh), 1, out);
+		fwrite(payload.data(), 1, payload.size(), out);
+		bytes_written += sizeof(fh) + payload.size();
+		++frames_written;
+
+		reference = state;
+		tail.store(next, std::memory_order_release);
+		++next;
+	}
+	tail.store(next, std::memory_order_release);
+}
+
+
+void StateDumpWriter::finish() {
+	if(writer.joinable()) {
+		stopping.store(true, std::memory_order_release);
+		writer.join();
+	}
+	if(out != NULL) {
+		fclose(out);
+		out = NULL;
+		SPDLOG_DEBUG(clog, "wrote {} population states in {} bytes", frames_written, bytes_written);
+	}
+}
+
+
+
+StateDumpReader::StateDumpReader(const std::string& path) : have_state(false), generation(-1) {
+	memset(&hdr, 0, sizeof(hdr));
+	in = fopen(path.c_str(), "rb");
+	if(in == NULL) {
+		clog->error("cannot open state dump file {}", path);
+		return;
+	}
+	if(fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != STATEDUMP_MAGIC) {
+		clog->error("{} is not a state dump file", path);
+		fclose(in);
+		in = NULL;
+		return;
+	}
+	state.resize((size_t)hdr.popsize * hdr.numloci);
+}
+
+
+StateDumpReader::~StateDumpReader() {
+	if(in != NULL) fclose(in);
+}
+
+
+bool StateDumpReader::next() {
+	if(in == NULL) return false;
+	StateFrameHeader fh;
+	if(fread(&fh, sizeof(fh), 1, in) != 1) return false;
+	if(fh.magic != STATEFRAME_MAGIC) {
+		clog->error("damaged state dump frame after generation {}", generation);
+		return false;
+	}
+	payload.resize(fh.payload_bytes);
+	if(fread(payload.data(), 1, fh.payload_bytes, in) != fh.payload_bytes) return false;
+
+	// a delta frame is only usable once a key frame has been decoded
+	bool key = (fh.flags & STATE_FRAME_KEY) != 0;
+	if(!key && !have_state) return false;
+	if(!decode_state_frame(payload.data(), payload.size(), (int)hdr.popsize, (int)hdr.numloci, state.data())) {
+		clog->error("damaged state dump frame at generation {}", fh.generation);
+		have_state = false;
+		return false;
+	}
+	have_state = true;
+	generation = (int)fh.generation;
+	return true;
+}
+
+
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include "defines.h"
+
+
+namespace CTModels {
+
+/*
+* State dump stream layout:  a StateDumpHeader, then one frame per dumped generation, each a StateFrameHeader 
+* followed by payload_bytes of encoded state.  Within a frame, each locus is encoded in turn as
+*
+*	varint  number of distinct traits d at the locus
+*	varint  the distinct traits in ascending order, as gaps from the previous trait
+*	byte    cell mode:  STATE_CELLS_ALL, or STATE_CELLS_CHANGED followed by a bitmap of popsize bits marking 
+*	        the individuals whose trait differs from the reference frame
+*	bits    the index of each encoded individual's trait among the d distinct traits, ceil(log2(d)) bits each
+*
+* The reference of a delta frame is the frame before it; key frames (STATE_FRAME_KEY) have no reference, and
+* one is written every keyframe_interval frames so a reader can resynchronize.  A locus with few traits packs
+* into a few bits per individual, and a locus where few individuals changed costs about one bit per individual.  
+*/
+
+const uint64_t STATEDUMP_MAGIC = 0x31504D4453504D4EULL;	// "NMPSDMP1"
+const uint32_t STATEFRAME_MAGIC = 0x4D415246;			// "FRAM"
+const uint32_t STATE_FRAME_KEY = 1;
+const uint8_t STATE_CELLS_ALL = 0;
+const uint8_t STATE_CELLS_CHANGED = 1;
+
+struct StateDumpHeader {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t numloci;
+	int64_t popsize;
+	int64_t keyframe_interval;
+};
+
+struct StateFrameHeader {
+	uint32_t magic;
+	uint32_t flags;
+	int64_t generation;
+	uint64_t payload_bytes;
+};
+
+
+/**
+* Encodes the popsize x numloci row-major trait matrix traits into out, as a delta against reference, or as
+* a key frame if reference is NULL.  
+*/
+void encode_state_frame(const int* traits, const int* reference, int popsize, int numloci, std::vector<uint8_t>& out);
+
+/**
+* Decodes a frame payload into traits.  For a delta frame, traits must hold the reference state on entry.
+* Returns false if the payload is malformed.
+*/
+bool decode_state_frame(const uint8_t* payload, size_t payload_bytes, int popsize, int numloci, int* traits);
+
+
+/** \class StateDumpWriter
+*
+* Writes a stream of compressed population states.  The simulation thread copies a state into a free slot 
+* of a small single-producer, single-consumer ring (claim() / publish()), and a background thread encodes 
+* each state against the previous one and writes it out, so compression and I/O overlap the simulation.  
+* Unlike time series samples, states are never dropped:  if the writer falls behind, claim() waits for a 
+* slot.  finish() drains the ring and closes the file.
+*/
+
+class StateDumpWriter {
+private:
+	FILE* out;
+	StateDumpHeader header;
+	size_t cells;
+	std::vector<int*> slots;
+	std::vector<int> slot_generation;
+	size_t mask;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+	std::thread writer;
+	std::atomic<bool> stopping;
+	uint64_t bytes_written;
+	long frames_written;
+
+	void drain();
+
+public:
+	StateDumpWriter(const std::string& path, int popsize, int numloci, int keyframe_interval, size_t capacity);
+	~StateDumpWriter();
+
+	bool is_open() { return out != NULL; }
+
+	/**
+	* Returns a buffer of popsize * numloci ints to fill with the state at generation, waiting for the writer 
+	* if every slot is in use.  
+	*/
+	int* claim(int generation);
+	void publish();
+
+	void finish();
+	uint64_t get_bytes_written() { return bytes_written; }
+	long get_frames_written() { return frames_written; }
+};
+
+
+/** \class StateDumpReader
+*
+* Reads a state dump stream frame by frame, reconstructing each full population state.
+*/
+
+class StateDumpReader {
+private:
+	FILE* in;
+	StateDumpHeader hdr;
+	std::vector<int> state;
+	std::vector<uint8_t> payload;
+	bool have_state;
+
+public:
+	int generation;
+
+	StateDumpReader(const std::string& path);
+	~StateDumpReader();
+
+	bool is_open() { return in != NULL; }
+	const StateDumpHeader& header() { return hdr; }
+
+	/**
+	* Advances to the next frame.  Returns false at the end of the stream or on a damaged frame.
+	*/
+	bool next();
+
+	/** The current state, popsize x numloci in row-major order. */
+	const int* traits() { return state.data(); }
+};
+
+};
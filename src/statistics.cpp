@@ -2,6 +2,8 @@
 #include <sstream>
 #include <iomanip>
 #include <memory>
+#include <climits>
+#include <math.h>
 #include <spdlog/spdlog.h>
 
 #include "statistics.h"
@@ -15,6 +17,67 @@ using namespace CTModels;
 
 namespace CTModels {
 
+void TraitFrequencies::build_occupancy() {
+	for(int locus = 0; locus < numloci; locus++) {
+		int* row = trait_counts + (size_t)locus * max_num_traits;
+		uint64_t* words = occupancy + (size_t)locus * occupancy_words;
+
+		for(int w = 0; w < occupancy_words; w++) {
+			int base = w * 64;
+			int nbits = (max_num_traits - base < 64) ? (max_num_traits - base) : 64;
+			uint64_t bits = 0;
+
+			#pragma omp simd reduction(|:bits)
+			for(int b = 0; b < nbits; b++) {
+				bits |= (uint64_t)(row[base + b] > 0) << b;
+			}
+			words[w] = bits;
+		}
+	}
+}
+
+
+/**
+* Lays out per-locus sparse counts as a TraitFrequencies with compact columns, in increasing trait order
+* at each locus, as wide as the most diverse locus.  Counts larger than an int can hold are clamped.  
+*/
+std::shared_ptr<TraitFrequencies> compact_trait_frequencies(const std::vector<TraitCounter>& counters) {
+	int numloci = counters.size();
+	std::vector<std::vector<std::pair<int, int64_t>>> present(numloci);
+	int width = 1;
+	for(int locus = 0; locus < numloci; locus++) {
+		std::vector<std::pair<int, int64_t>>& entries = present[locus];
+		counters[locus].for_each([&entries](int trait, int64_t n) { entries.push_back(std::make_pair(trait, n)); });
+		std::sort(entries.begin(), entries.end());
+		width = std::max(width, (int)entries.size());
+	}
+
+	std::shared_ptr<TraitFrequencies> tf(new TraitFrequencies(numloci, width));
+	tf->trait_ids.assign((size_t)numloci * width, -1);
+	for(int locus = 0; locus < numloci; locus++) {
+		for(size_t column = 0; column < present[locus].size(); column++) {
+			int64_t n = present[locus][column].second;
+			tf->trait_counts[(size_t)locus * width + column] = (n > INT_MAX) ? INT_MAX : (int)n;
+			tf->trait_ids[(size_t)locus * width + column] = present[locus][column].first;
+		}
+	}
+	tf->build_occupancy();
+	return tf;
+}
+
+
+int TraitFrequencies::occupied_traits(int locus) const {
+	const uint64_t* words = occupancy + (size_t)locus * occupancy_words;
+	int richness = 0;
+
+	#pragma omp simd reduction(+:richness)
+	for(int w = 0; w < occupancy_words; w++) {
+		richness += POPCOUNT64(words[w]);
+	}
+	return richness;
+}
+
+
 void print_trait_counts(std::shared_ptr<TraitFrequencies> tf) {
 	// skip if logging level isn't high enough
 	if(clog->level() == spd::level::trace) {
@@ -42,6 +105,24 @@ void print_trait_statistics(std::shared_ptr<TraitStatistics> ts) {
 		for(int locus = 0; locus < ts->numloci; locus++) {
 			std::stringstream s;
 			s << "richness @ locus: " << locus << ": " << locus_richness[locus];
+			s << " entropy: " << std::fixed << std::setprecision(4) << ts->shannon_entropy_by_locus[locus];
+			s << " simpson: " << ts->simpson_diversity_by_locus[locus];
+			s << " evenness: " << ts->evenness_by_locus[locus];
+			s << " dominant freq: " << ts->dominant_freq_by_locus[locus];
+			SPDLOG_DEBUG(clog,"{}",s.str());
+		}
+	}
+}
+
+
+void print_trait_turnover(std::shared_ptr<TraitTurnover> tt) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+
+		for(int locus = 0; locus < tt->numloci; locus++) {
+			std::stringstream s;
+			s << "turnover @ locus: " << locus << ": born: " << tt->born_by_locus[locus].size();
+			s << " extinct: " << tt->extinct_by_locus[locus].size();
 			SPDLOG_DEBUG(clog,"{}",s.str());
 		}
 	}
@@ -65,15 +146,47 @@ std::shared_ptr<TraitStatistics> calculate_trait_statistics(std::shared_ptr<Trai
 	timer.start("statistics::calculate_trait_statistics");
 	std::shared_ptr<TraitStatistics> ts(new TraitStatistics(tf->numloci));
 
+	// All of the diversity measures are computed from running reductions over each locus row,
+	// so the count array is swept exactly once.  Richness comes from the occupancy bitmap built
+	// during tabulation, which is 32x smaller than the counts themselves.  Given n = sum(c), Shannon entropy is recovered as
+	// ln(n) - sum(c ln c) / n, and Simpson diversity as 1 - sum(c^2) / n^2, which keeps the inner
+	// loop free of divisions and lets it vectorize.
 	int* locus_counts = tf->trait_counts;
+	int max_num_traits = tf->max_num_traits;
+
+	#pragma omp parallel for if(tf->numloci * max_num_traits > 100000)
 	for(int locus = 0; locus < tf->numloci; locus++) {
-		int richness = 0;
+		int* row = locus_counts + (size_t)locus * max_num_traits;
+		int richness = tf->occupied_traits(locus);
+		int max_count = 0;
+		double total = 0.0;
+		double sum_sq = 0.0;
+		double sum_clogc = 0.0;
+
+		#pragma omp simd reduction(+:total,sum_sq,sum_clogc) reduction(max:max_count)
+		for(int trait = 0; trait < max_num_traits; trait++) {
+			int c = row[trait];
+			double dc = static_cast<double>(c);
+			total += dc;
+			sum_sq += dc * dc;
+			sum_clogc += (c > 0) ? dc * log(dc) : 0.0;
+			max_count = (c > max_count) ? c : max_count;
+		}
 
-		for(int trait = 0; trait < tf->max_num_traits; trait++) {
-			if(locus_counts[locus * tf->max_num_traits + trait] > 0) 
-				++richness;
+		double entropy = 0.0;
+		double simpson = 0.0;
+		double dominant = 0.0;
+		if(total > 0.0) {
+			entropy = log(total) - sum_clogc / total;
+			simpson = 1.0 - sum_sq / (total * total);
+			dominant = max_count / total;
 		}
+
 		ts->trait_richness_by_locus[locus] = richness;
+		ts->shannon_entropy_by_locus[locus] = entropy;
+		ts->simpson_diversity_by_locus[locus] = simpson;
+		ts->evenness_by_locus[locus] = (richness > 1) ? entropy / log((double)richness) : 1.0;
+		ts->dominant_freq_by_locus[locus] = dominant;
 	}
 
 	timer.end("statistics::calculate_trait_statistics");
@@ -81,6 +194,44 @@ std::shared_ptr<TraitStatistics> calculate_trait_statistics(std::shared_ptr<Trai
 }
 
 
+std::shared_ptr<TraitTurnover> diff_trait_occupancy(std::shared_ptr<TraitFrequencies> prev, std::shared_ptr<TraitFrequencies> curr) {
+	timer.start("statistics::diff_trait_occupancy");
+	std::shared_ptr<TraitTurnover> tt(new TraitTurnover(curr->numloci));
+
+	// The two samples may have different widths, since new traits enlarge later tabulations.  Words
+	// past the end of the narrower bitmap are treated as empty.  Within each word, set bits of 
+	// (curr & ~prev) are births and set bits of (prev & ~curr) are extinctions, so we only ever
+	// visit the traits which actually changed state.
+	int words = (prev->occupancy_words > curr->occupancy_words) ? prev->occupancy_words : curr->occupancy_words;
+
+	for(int locus = 0; locus < curr->numloci; locus++) {
+		const uint64_t* prev_words = prev->occupancy + (size_t)locus * prev->occupancy_words;
+		const uint64_t* curr_words = curr->occupancy + (size_t)locus * curr->occupancy_words;
+		std::vector<int>& born = tt->born_by_locus[locus];
+		std::vector<int>& extinct = tt->extinct_by_locus[locus];
+
+		for(int w = 0; w < words; w++) {
+			uint64_t p = (w < prev->occupancy_words) ? prev_words[w] : 0;
+			uint64_t c = (w < curr->occupancy_words) ? curr_words[w] : 0;
+
+			uint64_t births = c & ~p;
+			while(births) {
+				born.push_back(w * 64 + CTZ64(births));
+				births &= births - 1;
+			}
+			uint64_t deaths = p & ~c;
+			while(deaths) {
+				extinct.push_back(w * 64 + CTZ64(deaths));
+				deaths &= deaths - 1;
+			}
+		}
+	}
+
+	timer.end("statistics::diff_trait_occupancy");
+	return tt;
+}
+
+
 
 };
 
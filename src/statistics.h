@@ -1,4 +1,7 @@
 #pragma once
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
 #include <spdlog/spdlog.h>
 #include "defines.h"
 #include "globals.h"
@@ -7,6 +10,8 @@
 
 namespace CTModels {
 
+class NeutralityTests;
+
 /** \class TraitFrequencies
 *
 * TraitFrequencies bundles a rectangular array of integers, formatted as a simple 1-D 
@@ -14,48 +19,220 @@ namespace CTModels {
 * has loci as rows and traits within a locus as columns, so the array is addressed
 * as:  trait_counts[locus * max_num_traits + trait]
 *
+* Alongside the counts, an occupancy bitmap records which traits are present at each locus,
+* one bit per trait packed into 64-bit words.  Bit (trait % 64) of 
+* occupancy[locus * occupancy_words + trait / 64] is set iff the trait has a nonzero count, 
+* so richness is a popcount over occupancy_words words, and births and extinctions between 
+* two samples are found by XOR'ing their bitmaps.  The bitmap is filled in by build_occupancy(), 
+* which tabulation calls once the counts are complete.
+*
+* Counts over a sample may instead use compact columns, numbered densely from 0 in order of first 
+* appearance at each locus, so their size follows the traits actually sampled rather than every trait
+* ever introduced.  trait_ids[locus * max_num_traits + column] then holds the trait each column counts 
+* (-1 for unused columns), and trait_id() maps columns back to traits.  trait_ids is empty when column
+* and trait coincide; only such frequencies can be compared with diff_trait_occupancy().  
+*
 */
 
 class TraitFrequencies {
 public:
 	int* trait_counts; 
+	uint64_t* occupancy;
 	int numloci;
 	int max_num_traits;
+	int occupancy_words;
+	std::vector<int> trait_ids;
 
 	TraitFrequencies(int n, int m) : numloci(n), max_num_traits(m) {
 		int count_bufsize = (numloci * max_num_traits) * sizeof(int);
 		trait_counts = (int*) ALIGNED_MALLOC(count_bufsize);
 
+		occupancy_words = (max_num_traits + 63) / 64;
+		int occupancy_bufsize = (numloci * occupancy_words) * sizeof(uint64_t);
+		occupancy = (uint64_t*) ALIGNED_MALLOC(occupancy_bufsize);
+
 		//SPDLOG_DEBUG(clog, "TF initializing count array {:p} as {}x{} block with size {}", (void*)trait_counts, numloci, max_num_traits,count_bufsize);
 		memset(trait_counts, 0, count_bufsize);
+		memset(occupancy, 0, occupancy_bufsize);
 	}
 	~TraitFrequencies() { 
 		//SPDLOG_TRACE(log,"deallocating block trait_counts {:p}", (void*)trait_counts); 
 		FREE(trait_counts);
+		FREE(occupancy);
+	}
+
+	/**
+	* Packs the nonzero entries of trait_counts into the occupancy bitmap, 64 traits per word.
+	*/
+	void build_occupancy();
+
+	/**
+	* Returns the number of traits present at a locus, as a popcount over its occupancy words.
+	*/
+	int occupied_traits(int locus) const;
+
+	/**
+	* Returns the trait counted in a column at a locus.
+	*/
+	int trait_id(int locus, int column) const {
+		return trait_ids.empty() ? column : trait_ids[(size_t)locus * max_num_traits + column];
+	}
+};
+
+
+
+/** \class TraitCounter
+*
+* Sparse counts of the traits at one locus, in an open addressing table with linear probing.  Its size
+* follows the number of distinct traits counted, not the largest trait ID, so tallies of a population, a
+* thread's share of it or a sample cost nothing for traits that are long extinct.  Counts may be adjusted
+* downwards (as when an innovation replaces a copied trait), and entries left at zero are skipped by 
+* for_each().  clear() empties the table but keeps its capacity for the next round of counting.  
+*/
+
+class TraitCounter {
+private:
+	std::vector<int> keys;
+	std::vector<int64_t> counts;
+	size_t mask;
+	size_t used;
+	int shift;
+
+	size_t slot_of(int trait) const { return (size_t)(((uint64_t)(uint32_t)trait * 0x9E3779B97F4A7C15ULL) >> shift); }
+
+	void grow() {
+		std::vector<int> old_keys(keys.size() * 2, -1);
+		std::vector<int64_t> old_counts(counts.size() * 2, 0);
+		old_keys.swap(keys);
+		old_counts.swap(counts);
+		mask = keys.size() - 1;
+		--shift;
+		used = 0;
+		for(size_t i = 0; i < old_keys.size(); i++) {
+			if(old_keys[i] >= 0) add(old_keys[i], old_counts[i]);
+		}
+	}
+
+public:
+	TraitCounter() : keys(16, -1), counts(16, 0), mask(15), used(0), shift(60) {}
+
+	/** Adds n to the count of a trait, which must not be negative. */
+	inline void add(int trait, int64_t n) {
+		size_t slot = slot_of(trait);
+		while(keys[slot] != trait) {
+			if(keys[slot] < 0) {
+				if(2 * (used + 1) > keys.size()) {
+					grow();
+					add(trait, n);
+					return;
+				}
+				keys[slot] = trait;
+				++used;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		counts[slot] += n;
+	}
+
+	/** Returns the count of a trait, 0 if it has not been counted. */
+	int64_t get(int trait) const {
+		size_t slot = slot_of(trait);
+		while(keys[slot] >= 0) {
+			if(keys[slot] == trait) return counts[slot];
+			slot = (slot + 1) & mask;
+		}
+		return 0;
 	}
+
+	/** Calls f(trait, count) for every trait with a nonzero count, in no particular order. */
+	template<typename F>
+	void for_each(F f) const {
+		for(size_t i = 0; i < keys.size(); i++) {
+			if(keys[i] >= 0 && counts[i] != 0) f(keys[i], counts[i]);
+		}
+	}
+
+	/** Adds every count of another counter into this one. */
+	void merge(const TraitCounter& other) {
+		other.for_each([this](int trait, int64_t n) { add(trait, n); });
+	}
+
+	void clear() {
+		if(used == 0) return;
+		std::fill(keys.begin(), keys.end(), -1);
+		std::fill(counts.begin(), counts.end(), 0);
+		used = 0;
+	}
+
+	/** An upper bound on the number of traits with nonzero counts. */
+	size_t size() const { return used; }
+};
+
+
+
+/** \class TraitTurnover
+*
+* TraitTurnover holds the traits which were born (present now, absent in the previous sample) and
+* which went extinct (present in the previous sample, absent now) at each locus, between two 
+* successive TraitFrequencies samples.  Produced by diff_trait_occupancy().
+*/
+
+class TraitTurnover {
+public:
+	int numloci;
+	std::vector<std::vector<int>> born_by_locus;
+	std::vector<std::vector<int>> extinct_by_locus;
+
+	TraitTurnover(int numloci) : numloci(numloci), born_by_locus(numloci), extinct_by_locus(numloci) {}
 };
 
 
 
 /** \class TraitStatistics
 *
-* TraitStatistics bundle derived statistics from raw trait counts. 
+* TraitStatistics bundle derived statistics from raw trait counts.  All of the per-locus
+* diversity measures are filled in by a single pass over each locus row of a TraitFrequencies
+* object (see calculate_trait_statistics()), and each is stored as a numloci length array:
+*
+*   - trait_richness_by_locus:  number of traits with nonzero count
+*   - shannon_entropy_by_locus:  Shannon entropy H = -sum(p ln p), in nats
+*   - simpson_diversity_by_locus:  Gini-Simpson diversity 1 - sum(p^2)
+*   - evenness_by_locus:  Pielou's evenness H / ln(richness), defined as 1.0 when richness is 1
+*   - dominant_freq_by_locus:  relative frequency of the most common trait
+*
+* When neutrality tests are requested, their results travel with the statistics in neutrality_tests,
+* which is otherwise empty (see neutrality.h).
 */
 
 class TraitStatistics {
 public:
 	int* trait_richness_by_locus;
+	double* shannon_entropy_by_locus;
+	double* simpson_diversity_by_locus;
+	double* evenness_by_locus;
+	double* dominant_freq_by_locus;
+	std::shared_ptr<NeutralityTests> neutrality_tests;
 	int numloci;
 
 	TraitStatistics(int numloci) : numloci(numloci) {
 		int bufsize = numloci * sizeof(int);
+		int dbl_bufsize = numloci * sizeof(double);
 		trait_richness_by_locus = (int*) ALIGNED_MALLOC(bufsize); 
+		shannon_entropy_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
+		simpson_diversity_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
+		evenness_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
+		dominant_freq_by_locus = (double*) ALIGNED_MALLOC(dbl_bufsize);
 		//SPDLOG_DEBUG(clog, "TF initializing richness array {:p} as {} block with size {}", (void*)trait_richness_by_locus, numloci, bufsize);
 
 	}
 
 	~TraitStatistics() {
 		FREE(trait_richness_by_locus);
+		FREE(shannon_entropy_by_locus);
+		FREE(simpson_diversity_by_locus);
+		FREE(evenness_by_locus);
+		FREE(dominant_freq_by_locus);
 	}
 };
 
@@ -64,7 +241,10 @@ public:
 void print_trait_counts(std::shared_ptr<TraitFrequencies> tf);
 void print_trait_statistics(std::shared_ptr<TraitStatistics> ts);
 void print_event_timing();
+void print_trait_turnover(std::shared_ptr<TraitTurnover> tt);
 std::shared_ptr<TraitStatistics> calculate_trait_statistics(std::shared_ptr<TraitFrequencies> tf);
+std::shared_ptr<TraitFrequencies> compact_trait_frequencies(const std::vector<TraitCounter>& counters);
+std::shared_ptr<TraitTurnover> diff_trait_occupancy(std::shared_ptr<TraitFrequencies> prev, std::shared_ptr<TraitFrequencies> curr);
 
 
 
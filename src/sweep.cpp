@@ -0,0 +1,536 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <atomic>
+#include <math.h>
+#include <limits>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+#include "sweep.h"
+#include "scheduler.h"
+#include "globals.h"
+#include "timer.h"
+
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+// prediction before any history exists, roughly one cell copy per 10ns
+static const double DEFAULT_SECONDS_PER_CELL = 1e-8;
+
+
+static uint64_t fnv1a(const std::string& text, uint64_t h = 0xcbf29ce484222325ULL) {
+	for(size_t i = 0; i < text.size(); i++) {
+		h ^= (uint8_t)text[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+// splitmix64 finalizer, spreading consecutive job numbers into unrelated seeds
+static uint64_t mix_seed(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static std::string hex64(uint64_t v) {
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v);
+	return std::string(buf);
+}
+
+static const char* rule_name(ruletype rule) {
+	return (rule == WFIA) ? "wfia" : "basicwf";
+}
+
+
+std::shared_ptr<SweepSpec> SweepSpec::from_file(const std::string& path) {
+	std::ifstream in(path.c_str());
+	if(!in) {
+		clog->error("cannot read sweep file {}", path);
+		return std::shared_ptr<SweepSpec>();
+	}
+
+	std::shared_ptr<SweepSpec> spec(new SweepSpec());
+	std::string line;
+	int line_num = 0;
+	while(std::getline(in, line)) {
+		++line_num;
+		spec->spec_hash = fnv1a(line + "\n", line_num == 1 ? 0xcbf29ce484222325ULL : spec->spec_hash);
+		std::istringstream fields(line);
+		std::string key;
+		if(!(fields >> key) || key[0] == '#') continue;
+
+		std::vector<double>* values = nullptr;
+		if(key == "popsize") values = &spec->popsize;
+		else if(key == "numloci") values = &spec->numloci;
+		else if(key == "inittraits") values = &spec->inittraits;
+		else if(key == "innovrate") values = &spec->innovrate;
+		else if(key == "simlength") values = &spec->simlength;
+
+		// the sizes a population needs must be at least 1, so that neither a grid value (truncated) nor a
+		// Latin hypercube point between two of them (rounded) can come out as 0
+		bool sizes = (key == "popsize" || key == "numloci" || key == "inittraits");
+
+		bool ok = true;
+		if(values != nullptr) {
+			double v;
+			while(fields >> v) {
+				values->push_back(v);
+				if(sizes && !(v >= 1.0)) {
+					clog->error("{}:{}: {} must be at least 1", path, line_num, key);
+					return std::shared_ptr<SweepSpec>();
+				}
+			}
+			ok = !values->empty() && fields.eof();
+		}
+		else if(key == "ruletype") {
+			std::string rule;
+			while(fields >> rule) {
+				if(rule == "basicwf") spec->rules.push_back(BASICWF);
+				else if(rule == "wfia") spec->rules.push_back(WFIA);
+				else ok = false;
+			}
+		}
+		else if(key == "design") {
+			std::string design;
+			fields >> design;
+			spec->latin_hypercube = (design == "lhs");
+			ok = (design == "lhs" || design == "grid");
+		}
+		else if(key == "samples") {
+			ok = (fields >> spec->samples) && spec->samples > 0;
+		}
+		else if(key == "replicates") {
+			ok = (fields >> spec->replicates) && spec->replicates > 0;
+		}
+		else if(key == "seed") {
+			ok = (bool)(fields >> spec->seed);
+			spec->has_seed = true;
+		}
+		else {
+			ok = false;
+		}
+
+		if(!ok) {
+			clog->error("{}:{}: malformed sweep specification line", path, line_num);
+			return std::shared_ptr<SweepSpec>();
+		}
+	}
+
+	if(spec->popsize.empty() || spec->numloci.empty() || spec->inittraits.empty() || spec->innovrate.empty() || spec->simlength.empty()) {
+		clog->error("sweep file {} must give popsize, numloci, inittraits, innovrate and simlength", path);
+		return std::shared_ptr<SweepSpec>();
+	}
+	if(spec->latin_hypercube && spec->samples == 0) {
+		clog->error("sweep file {} asks for a Latin hypercube without a number of samples", path);
+		return std::shared_ptr<SweepSpec>();
+	}
+	if(spec->rules.empty()) spec->rules.push_back(WFIA);
+	return spec;
+}
+
+
+// the configurations, or none if any of them cannot be simulated
+static std::vector<RunParameters> validated(const std::vector<RunParameters>& configs) {
+	for(size_t c = 0; c < configs.size(); c++) {
+		const RunParameters& p = configs[c];
+		if(!valid_run_parameters(p)) {
+			clog->error("sweep configuration {} has popsize {}, numloci {} and inittraits {}, which must all be positive", 
+				c, p.popsize, p.numloci, p.inittraits);
+			return std::vector<RunParameters>();
+		}
+	}
+	return configs;
+}
+
+
+std::vector<RunParameters> SweepSpec::expand() {
+	std::vector<RunParameters> configs;
+	RunParameters p;
+
+	if(!latin_hypercube) {
+		for(auto rule : rules)
+		for(double ps : popsize)
+		for(double nl : numloci)
+		for(double it : inittraits)
+		for(double ir : innovrate)
+		for(double sl : simlength) {
+			p.popsize = (int)ps;
+			p.numloci = (int)nl;
+			p.inittraits = (int)it;
+			p.innovation_rate = ir;
+			p.simlength = (int)sl;
+			p.rule = rule;
+			configs.push_back(p);
+		}
+		return validated(configs);
+	}
+
+	// Latin hypercube:  each dimension's range is cut into samples strata, and a random permutation per
+	// dimension assigns every point a different stratum, jittered uniformly within it
+	std::random_device rd;
+	std::mt19937_64 eng(rd());
+	std::uniform_real_distribution<double> jitter(0.0, 1.0);
+	std::vector<std::vector<double>*> dims = { &popsize, &numloci, &inittraits, &innovrate, &simlength };
+	std::vector<std::vector<double>> points(dims.size(), std::vector<double>(samples));
+
+	for(size_t d = 0; d < dims.size(); d++) {
+		double lo = dims[d]->front();
+		double hi = dims[d]->back();
+		bool log_scale = (dims[d] == &innovrate) && lo > 0.0 && hi > 0.0;
+		if(log_scale) {
+			lo = log(lo);
+			hi = log(hi);
+		}
+		std::vector<int> strata(samples);
+		for(int i = 0; i < samples; i++) strata[i] = i;
+		std::shuffle(strata.begin(), strata.end(), eng);
+		for(int i = 0; i < samples; i++) {
+			double x = lo + (hi - lo) * (strata[i] + jitter(eng)) / samples;
+			points[d][i] = log_scale ? exp(x) : x;
+		}
+	}
+
+	for(auto rule : rules) {
+		for(int i = 0; i < samples; i++) {
+			p.popsize = (int)lround(points[0][i]);
+			p.numloci = (int)lround(points[1][i]);
+			p.inittraits = (int)lround(points[2][i]);
+			p.innovation_rate = points[3][i];
+			p.simlength = (int)lround(points[4][i]);
+			p.rule = rule;
+			configs.push_back(p);
+		}
+	}
+	return validated(configs);
+}
+
+
+
+
+SweepCostModel::SweepCostModel() {
+	for(int r = 0; r < 2; r++) {
+		seconds_per_cell[r] = DEFAULT_SECONDS_PER_CELL;
+		sum_xy[r] = 0.0;
+		sum_xx[r] = 0.0;
+	}
+}
+
+
+void SweepCostModel::load_history(const std::string& path) {
+	std::ifstream in(path.c_str());
+	if(!in) return;
+	RunParameters p;
+	std::string rule;
+	double seconds;
+	int timings = 0;
+	while(in >> p.popsize >> p.numloci >> rule >> p.simlength >> seconds) {
+		p.rule = (rule == "wfia") ? WFIA : BASICWF;
+		observe(p, seconds);
+		++timings;
+	}
+	SPDLOG_DEBUG(clog, "cost model fitted to {} past timings: {:.3e} s/cell basicwf, {:.3e} s/cell wfia", 
+		timings, seconds_per_cell[BASICWF], seconds_per_cell[WFIA]);
+}
+
+
+void SweepCostModel::observe(const RunParameters& params, double seconds) {
+	double cells = (double)params.popsize * params.numloci * params.simlength;
+	sum_xy[params.rule] += cells * seconds;
+	sum_xx[params.rule] += cells * cells;
+	seconds_per_cell[params.rule] = sum_xy[params.rule] / sum_xx[params.rule];
+}
+
+
+double SweepCostModel::predict(const RunParameters& params) {
+	return seconds_per_cell[params.rule] * params.popsize * params.numloci * params.simlength;
+}
+
+
+
+std::string sweep_job_key(const RunParameters& params, uint64_t seed) {
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%d %d %d %.17g %s %d %llu ", params.popsize, params.numloci, params.inittraits, 
+		params.innovation_rate, rule_name(params.rule), params.simlength, (unsigned long long)seed);
+	return hex64(fnv1a(std::string(buf) + SWEEP_ENGINE_VERSION));
+}
+
+
+
+SweepState::SweepState(const std::string& dir) : dir(dir) {
+	std::string index_path = dir + "/index";
+	std::ifstream in(index_path.c_str());
+	std::string key;
+	while(in >> key) {
+		completed.insert(key);
+		in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+	}
+	index = fopen(index_path.c_str(), "a");
+	if(index == NULL) {
+		clog->error("cannot open sweep index {}", index_path);
+	}
+}
+
+
+SweepState::~SweepState() {
+	if(index != NULL) fclose(index);
+}
+
+
+bool SweepState::read_manifest(const SweepSpec& spec, std::vector<SweepJob>& jobs) {
+	std::string path = dir + "/manifest-" + hex64(spec.spec_hash);
+	std::ifstream in(path.c_str());
+	if(!in) return false;
+
+	std::string line;
+	while(std::getline(in, line)) {
+		if(line.empty() || line[0] == '#') continue;
+		std::istringstream fields(line);
+		SweepJob job;
+		std::string rule;
+		unsigned long long seed;
+		if(!(fields >> job.key >> job.config_index >> job.replicate >> job.params.popsize >> job.params.numloci 
+			>> job.params.inittraits >> job.params.innovation_rate >> rule >> job.params.simlength >> seed)
+			|| !valid_run_parameters(job.params)) {
+			clog->error("damaged sweep manifest {}", path);
+			jobs.clear();
+			return false;
+		}
+		job.params.rule = (rule == "wfia") ? WFIA : BASICWF;
+		job.seed = seed;
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+
+void SweepState::write_manifest(const SweepSpec& spec, const std::vector<SweepJob>& jobs) {
+	std::string path = dir + "/manifest-" + hex64(spec.spec_hash);
+	FILE* out = fopen(path.c_str(), "w");
+	if(out == NULL) {
+		clog->error("cannot write sweep manifest {}", path);
+		return;
+	}
+	fprintf(out, "# key config replicate popsize numloci inittraits innovrate rule simlength seed (engine %s)\n", SWEEP_ENGINE_VERSION.c_str());
+	for(auto it = jobs.begin(); it != jobs.end(); ++it) {
+		const RunParameters& p = it->params;
+		fprintf(out, "%s %d %d %d %d %d %.17g %s %d %llu\n", it->key.c_str(), it->config_index, it->replicate, 
+			p.popsize, p.numloci, p.inittraits, p.innovation_rate, rule_name(p.rule), p.simlength, (unsigned long long)it->seed);
+	}
+	fclose(out);
+}
+
+
+bool SweepState::is_complete(const std::string& key) {
+	std::lock_guard<std::mutex> guard(lock);
+	return completed.count(key) > 0;
+}
+
+
+void SweepState::mark_complete(const SweepJob& job) {
+	std::lock_guard<std::mutex> guard(lock);
+	completed.insert(job.key);
+	fprintf(index, "%s %d %d\n", job.key.c_str(), job.config_index, job.replicate);
+	fflush(index);
+}
+
+
+
+ReplicateResult run_sweep_job(Population& pop, const SweepJob& job, SweepState* state, int checkpoint_interval, 
+	const std::atomic<int>* allotment, bool& resumed) {
+	resumed = false;
+	if(state == nullptr) {
+		pop.set_seed(job.seed);
+		return run_replicate(pop, job.params, job.config_index, job.replicate, allotment);
+	}
+
+	std::string ckpt = state->checkpoint_path(job.key);
+	std::shared_ptr<CheckpointWriter> checkpointer;
+	if(checkpoint_interval > 0) {
+		checkpointer.reset(new CheckpointWriter(ckpt));
+	}
+
+	ReplicateResult result;
+	std::unique_ptr<Population> restored;
+	ruletype restored_rule = job.params.rule;
+	if(access(ckpt.c_str(), R_OK) == 0) {
+		restored.reset(Population::from_checkpoint(ckpt, restored_rule));
+	}
+	if(restored && restored->get_popsize() == job.params.popsize && restored->get_numloci() == job.params.numloci
+		&& restored_rule == job.params.rule) {
+		SPDLOG_DEBUG(clog, "sweep: resuming job {} at generation {}", job.key, restored->get_generation());
+		resumed = true;
+		result = continue_replicate(*restored, job.params, job.config_index, job.replicate, allotment, checkpointer.get(), checkpoint_interval);
+	}
+	else {
+		pop.set_seed(job.seed);
+		pop.reset(job.params.popsize, job.params.numloci, job.params.inittraits, job.params.innovation_rate);
+		result = continue_replicate(pop, job.params, job.config_index, job.replicate, allotment, checkpointer.get(), checkpoint_interval);
+	}
+
+	if(checkpointer) {
+		checkpointer->wait();
+	}
+	remove(ckpt.c_str());
+	return result;
+}
+
+
+std::vector<SweepJob> prepare_sweep_jobs(SweepSpec& spec, SweepState* state, SweepCostModel& model, std::vector<double>& expected) {
+	// a restarted sweep takes its jobs from the manifest, so that Latin hypercube points and seeds are the
+	// same as the first time
+	std::vector<SweepJob> all_jobs;
+	if(state == nullptr || !state->read_manifest(spec, all_jobs)) {
+		std::vector<RunParameters> configs = spec.expand();
+		uint64_t base_seed = spec.has_seed ? spec.seed : std::random_device()();
+		for(size_t c = 0; c < configs.size(); c++) {
+			for(int rep = 0; rep < spec.replicates; rep++) {
+				SweepJob job;
+				job.params = configs[c];
+				job.config_index = c;
+				job.replicate = rep;
+				job.seed = mix_seed(base_seed + all_jobs.size());
+				job.key = sweep_job_key(job.params, job.seed);
+				all_jobs.push_back(job);
+			}
+		}
+		if(state != nullptr) {
+			state->write_manifest(spec, all_jobs);
+		}
+	}
+
+	// skip jobs whose results already exist, and jobs repeated within the sweep
+	std::vector<SweepJob> jobs;
+	std::unordered_set<std::string> seen;
+	for(auto it = all_jobs.begin(); it != all_jobs.end(); ++it) {
+		if(seen.insert(it->key).second && !(state != nullptr && state->is_complete(it->key))) {
+			jobs.push_back(*it);
+		}
+	}
+	int num_jobs = jobs.size();
+	if(num_jobs < (int)all_jobs.size()) {
+		clog->info("sweep: {} of {} jobs already completed", all_jobs.size() - num_jobs, all_jobs.size());
+	}
+
+	// longest expected first
+	std::vector<int> order(num_jobs);
+	std::vector<double> cost(num_jobs);
+	for(int j = 0; j < num_jobs; j++) {
+		cost[j] = model.predict(jobs[j].params);
+		order[j] = j;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return cost[a] > cost[b]; });
+
+	std::vector<SweepJob> ordered;
+	expected.clear();
+	for(int j : order) {
+		ordered.push_back(jobs[j]);
+		expected.push_back(cost[j]);
+	}
+	return ordered;
+}
+
+
+void append_sweep_history(const std::string& history_path, const std::vector<SweepJob>& jobs, const std::vector<double>& elapsed) {
+	std::ofstream history(history_path.c_str(), std::ios::app);
+	for(size_t j = 0; j < jobs.size(); j++) {
+		const RunParameters& p = jobs[j].params;
+		if(elapsed[j] >= 0.0) {
+			history << p.popsize << " " << p.numloci << " " << rule_name(p.rule) << " " << p.simlength << " " << elapsed[j] << "\n";
+		}
+	}
+}
+
+
+long run_sweep(SweepSpec& spec, BatchOutput& output, const std::string& history_path, SweepState* state, int checkpoint_interval) {
+	timer.start("sweep::run_sweep");
+	SweepCostModel model;
+	if(!history_path.empty()) {
+		model.load_history(history_path);
+	}
+	std::vector<double> expected;
+	std::vector<SweepJob> jobs = prepare_sweep_jobs(spec, state, model, expected);
+	int num_jobs = jobs.size();
+	if(num_jobs == 0) {
+		timer.end("sweep::run_sweep");
+		return 0;
+	}
+
+	// greedy least-loaded assignment, in longest-first order, then each worker's lane is filled so that it
+	// takes its own longest job first from the back while thieves take the shortest from the front
+	int max_threads = MAX_THREADS();
+	int workers = std::max(1, std::min(max_threads, num_jobs));
+	std::vector<std::vector<int>> lanes(workers);
+	std::vector<double> load(workers, 0.0);
+	for(int j = 0; j < num_jobs; j++) {
+		int w = std::min_element(load.begin(), load.end()) - load.begin();
+		lanes[w].push_back(j);
+		load[w] += expected[j];
+	}
+	WorkStealingQueues queues(workers);
+	for(int w = 0; w < workers; w++) {
+		for(auto it = lanes[w].rbegin(); it != lanes[w].rend(); ++it) {
+			queues.push(w, *it);
+		}
+	}
+	SPDLOG_DEBUG(clog, "sweep: {} jobs on {} workers, {:.1f}s expected", num_jobs, workers, *std::max_element(load.begin(), load.end()));
+
+	std::vector<double> elapsed(num_jobs, -1.0);
+	std::atomic<int> active(workers);
+	std::atomic<int> allotment(1);
+	std::atomic<long> runs(0);
+
+#if defined(_OPENMP)
+	int saved_levels = omp_get_max_active_levels();
+	omp_set_max_active_levels(2);
+#endif
+
+	#pragma omp parallel num_threads(workers)
+	{
+		int worker = THREAD_NUM();
+		const RunParameters& first = jobs[0].params;
+		Population pop(first.popsize, first.numloci, first.inittraits, first.innovation_rate);
+		int j;
+		while(queues.pop(worker, j)) {
+			bool resumed;
+			ReplicateResult result = run_sweep_job(pop, jobs[j], state, checkpoint_interval, &allotment, resumed);
+			// a resumed job's time covers only part of it, which would mislead the cost model
+			if(!resumed) elapsed[j] = result.elapsed;
+			output.write(jobs[j].params, result);
+			if(state != nullptr) {
+				output.flush();
+				state->mark_complete(jobs[j]);
+			}
+			++runs;
+		}
+
+		// nothing left to take or steal, so lend this thread to the jobs still running
+		int remaining = --active;
+		if(remaining > 0) {
+			allotment.store(std::max(1, max_threads / remaining));
+		}
+	}
+
+#if defined(_OPENMP)
+	omp_set_max_active_levels(saved_levels);
+#endif
+	output.flush();
+
+	if(!history_path.empty()) {
+		append_sweep_history(history_path, jobs, elapsed);
+	}
+
+	timer.end("sweep::run_sweep");
+	return runs;
+}
+
+
+};
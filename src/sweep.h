@@ -0,0 +1,190 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include "defines.h"
+#include "batch.h"
+
+
+namespace CTModels {
+
+// part of every sweep job's key, so results from an engine whose output may differ are never reused
+const std::string SWEEP_ENGINE_VERSION = "0.0.1";
+
+/** \class SweepSpec
+*
+* A parameter sweep, read from a text file of keyword lines:
+*
+*	design grid | lhs         full factorial grid (default), or Latin hypercube
+*	samples N                 number of Latin hypercube points
+*	replicates R              replicates of every point (default 1)
+*	popsize v1 v2 ...         values (grid), or min max (lhs)
+*	numloci v1 v2 ...
+*	inittraits v1 v2 ...
+*	innovrate v1 v2 ...       sampled on a log scale in a Latin hypercube when both bounds are positive
+*	simlength v1 v2 ...
+*	ruletype basicwf wfia     rules to combine with every point
+*	seed S                    base of the per-job random seeds (default drawn at random)
+*
+* Blank lines and lines starting with # are ignored.  A parameter given a single value is held constant.
+* Values of popsize, numloci and inittraits must be at least 1.
+*/
+
+class SweepSpec {
+public:
+	bool latin_hypercube;
+	int samples;
+	int replicates;
+	std::vector<double> popsize;
+	std::vector<double> numloci;
+	std::vector<double> inittraits;
+	std::vector<double> innovrate;
+	std::vector<double> simlength;
+	std::vector<ruletype> rules;
+	bool has_seed;
+	uint64_t seed;
+	uint64_t spec_hash;
+
+	SweepSpec() : latin_hypercube(false), samples(0), replicates(1), has_seed(false), seed(0), spec_hash(0) {}
+
+	/**
+	* Reads a sweep specification, returning an empty pointer if the file cannot be read or is malformed.
+	*/
+	static std::shared_ptr<SweepSpec> from_file(const std::string& path);
+
+	/**
+	* Expands the specification into its configurations:  the cartesian product of all values for a grid,
+	* or samples stratified points per rule for a Latin hypercube.  Returns no configurations if any of them
+	* fails valid_run_parameters().  
+	*/
+	std::vector<RunParameters> expand();
+};
+
+
+/** \class SweepJob
+*
+* One replicate of one configuration, with the seed that makes it reproducible and its key:  a hash of
+* parameters, seed and engine version identifying the result wherever and whenever it was computed.
+*/
+
+class SweepJob {
+public:
+	RunParameters params;
+	int config_index;
+	int replicate;
+	uint64_t seed;
+	std::string key;
+};
+
+/**
+* Returns the key of a job, as 16 hex digits of a 64-bit FNV-1a hash of its parameters, seed and 
+* SWEEP_ENGINE_VERSION.
+*/
+std::string sweep_job_key(const RunParameters& params, uint64_t seed);
+
+
+/** \class SweepState
+*
+* The on-disk state that makes sweeps resumable, kept in one directory:
+*
+*	manifest-<spec hash>   every job of a sweep, written before any job runs, so a restarted sweep 
+*	                       runs exactly the same jobs (and Latin hypercube points) with the same seeds
+*	index                  keys of completed jobs, one per line, appended as each result is written
+*	<key>.ckpt             the latest checkpoint of a job in progress, removed when it completes
+*
+* The index is shared by every sweep using the directory, so a job already computed by any earlier sweep
+* is not computed again.  A result is written before its key is indexed, so a crash in between can 
+* duplicate a result line but never lose one.  
+*/
+
+class SweepState {
+private:
+	std::string dir;
+	std::unordered_set<std::string> completed;
+	FILE* index;
+	std::mutex lock;
+
+public:
+	SweepState(const std::string& dir);
+	~SweepState();
+
+	bool is_open() { return index != NULL; }
+
+	/**
+	* Reads the manifest for a sweep specification into jobs.  Returns false if there is none yet.
+	*/
+	bool read_manifest(const SweepSpec& spec, std::vector<SweepJob>& jobs);
+	void write_manifest(const SweepSpec& spec, const std::vector<SweepJob>& jobs);
+
+	bool is_complete(const std::string& key);
+	void mark_complete(const SweepJob& job);
+	std::string checkpoint_path(const std::string& key) { return dir + "/" + key + ".ckpt"; }
+};
+
+
+/** \class SweepCostModel
+*
+* Predicts the wall clock time of a replicate as seconds_per_cell[rule] * popsize * numloci * simlength, 
+* with one coefficient per copying rule fitted by least squares through the origin to past timings.  The
+* history file holds one timing per line (popsize numloci rule simlength seconds) and grows with each
+* sweep, so predictions improve as the sweeps accumulate.
+*/
+
+class SweepCostModel {
+private:
+	double seconds_per_cell[2];
+	double sum_xy[2];
+	double sum_xx[2];
+
+public:
+	SweepCostModel();
+
+	/** Fits the model to a timing history file; a missing file leaves the default coefficients. */
+	void load_history(const std::string& path);
+	void observe(const RunParameters& params, double seconds);
+	double predict(const RunParameters& params);
+};
+
+
+/**
+* Returns the jobs of a sweep still to be run, longest expected first, with their expected times in 
+* expected.  Jobs come from the state's manifest if it has one for spec; otherwise the spec is expanded, 
+* each job given a seed, and the manifest written.  Jobs already in the state's index, and repeats of a 
+* key within the sweep, are left out.  
+*/
+std::vector<SweepJob> prepare_sweep_jobs(SweepSpec& spec, SweepState* state, SweepCostModel& model, std::vector<double>& expected);
+
+/**
+* Runs one sweep job on pop, seeded with the job's seed.  With a state, the job continues from its
+* checkpoint if there is one (in a population restored from it), is checkpointed every checkpoint_interval
+* generations, and has its checkpoint removed when done.  resumed reports whether a checkpoint was used.
+*/
+ReplicateResult run_sweep_job(Population& pop, const SweepJob& job, SweepState* state, int checkpoint_interval, 
+	const std::atomic<int>* allotment, bool& resumed);
+
+/**
+* Appends the timings of jobs that ran from the start (elapsed >= 0) to a cost model history file.
+*/
+void append_sweep_history(const std::string& history_path, const std::vector<SweepJob>& jobs, const std::vector<double>& elapsed);
+
+/**
+* Runs every replicate of every configuration of a sweep, one replicate per worker thread, writing each
+* result to output as it completes.  Jobs are ordered longest expected first by the cost model and dealt to 
+* per-worker work-stealing queues by greedy least-loaded assignment; a worker whose queue empties steals
+* the shortest remaining jobs from the others, and once nothing is left to steal, its thread is lent to the
+* jobs still running.  If history_path is not empty, the cost model is fitted to it beforehand and the 
+* observed timings are appended to it afterwards.  
+*
+* If state is given, the sweep is resumable:  jobs come from its manifest if the sweep was started before,
+* jobs already in its index are skipped, jobs with a checkpoint continue from it, and running jobs are
+* checkpointed every checkpoint_interval generations if that is positive.  Returns the number of replicates run.  
+*/
+long run_sweep(SweepSpec& spec, BatchOutput& output, const std::string& history_path, SweepState* state = nullptr, int checkpoint_interval = 0);
+
+};
@@ -13,21 +13,25 @@ namespace CTModels {
 
 void Timer::start(std::string label) {
 	auto start_point = std::chrono::high_resolution_clock::now();
-	start_times[label] = start_point;
+	std::lock_guard<std::mutex> guard(lock);
+	start_times[std::this_thread::get_id()][label] = start_point;
 }
 
 void Timer::end(std::string label) {
 	auto end_point = std::chrono::high_resolution_clock::now();
-	auto start = start_times[label];
+	std::lock_guard<std::mutex> guard(lock);
+	auto start = start_times[std::this_thread::get_id()][label];
 	completed_times[label] = std::chrono::duration <double, std::milli>(end_point - start).count();
 }
 
 double Timer::interval_ms(std::string label) {
+	std::lock_guard<std::mutex> guard(lock);
 	return completed_times[label];
 }
 
 std::vector<std::string> Timer::get_timed_events() {
 	std::vector<std::string> labels;
+	std::lock_guard<std::mutex> guard(lock);
 	for(auto it = completed_times.cbegin(); it != completed_times.cend(); ++it) {
 		labels.push_back(it->first);
 	}
@@ -5,6 +5,8 @@
 #include <unordered_map>
 #include <string>
 #include <vector>
+#include <mutex>
+#include <thread>
 
 
 namespace CTModels {
@@ -14,13 +16,16 @@ namespace CTModels {
 *
 * Simple timer class for timing sections of code using the C++11 chrono library, and the system
 * "steady clock".  Allows multiple events to be timed and the results cached for later use under an interval label.    
+* Start times are kept per thread, so the same label may be timed concurrently by replicates running on 
+* different threads; the most recently completed interval is the one reported.
 *
 */
 
 class Timer {
 private:
 	std::unordered_map<std::string, double> completed_times;
-	std::unordered_map<std::string, std::chrono::high_resolution_clock::time_point>	start_times;  
+	std::unordered_map<std::thread::id, std::unordered_map<std::string, std::chrono::high_resolution_clock::time_point>> start_times;  
+	std::mutex lock;
 	// end time cache not needed
 
 public:
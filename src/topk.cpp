@@ -0,0 +1,192 @@
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_set>
+#include <queue>
+#include <functional>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+#include "topk.h"
+#include "statistics.h"
+#include "globals.h"
+#include "timer.h"
+
+namespace spd = spdlog;
+using namespace CTModels;
+
+
+
+namespace CTModels {
+
+void SpaceSavingSketch::swap_slots(int a, int b) {
+	std::swap(heap_traits[a], heap_traits[b]);
+	std::swap(heap_counts[a], heap_counts[b]);
+	slot_of_trait[heap_traits[a]] = a;
+	slot_of_trait[heap_traits[b]] = b;
+}
+
+
+void SpaceSavingSketch::sift_down(int slot) {
+	int n = heap_counts.size();
+	while(true) {
+		int smallest = slot;
+		int left = 2 * slot + 1;
+		int right = left + 1;
+		if(left < n && heap_counts[left] < heap_counts[smallest]) smallest = left;
+		if(right < n && heap_counts[right] < heap_counts[smallest]) smallest = right;
+		if(smallest == slot) return;
+		swap_slots(slot, smallest);
+		slot = smallest;
+	}
+}
+
+
+void SpaceSavingSketch::add(int trait, int count) {
+	auto it = slot_of_trait.find(trait);
+	if(it != slot_of_trait.end()) {
+		// counts only grow, so a monitored trait can only need to move away from the root
+		heap_counts[it->second] += count;
+		sift_down(it->second);
+		return;
+	}
+
+	if((int)heap_counts.size() < capacity) {
+		// appending a new entry:  sift it up toward the root
+		int slot = heap_counts.size();
+		heap_traits.push_back(trait);
+		heap_counts.push_back(count);
+		slot_of_trait[trait] = slot;
+		while(slot > 0 && heap_counts[(slot - 1) / 2] > heap_counts[slot]) {
+			swap_slots(slot, (slot - 1) / 2);
+			slot = (slot - 1) / 2;
+		}
+		return;
+	}
+
+	// evict the minimum, and let the newcomer inherit its count as an upper bound
+	slot_of_trait.erase(heap_traits[0]);
+	heap_traits[0] = trait;
+	heap_counts[0] += count;
+	slot_of_trait[trait] = 0;
+	sift_down(0);
+}
+
+
+void SpaceSavingSketch::merge(const SpaceSavingSketch& other) {
+	int this_min = min_count();
+	int other_min = other.min_count();
+
+	std::unordered_map<int,int> combined;
+	combined.reserve((heap_traits.size() + other.heap_traits.size()) * 2);
+	for(size_t i = 0; i < heap_traits.size(); i++) {
+		bool in_other = other.slot_of_trait.count(heap_traits[i]) > 0;
+		combined[heap_traits[i]] = heap_counts[i] + (in_other ? 0 : other_min);
+	}
+	for(size_t i = 0; i < other.heap_traits.size(); i++) {
+		auto it = combined.find(other.heap_traits[i]);
+		if(it != combined.end()) it->second += other.heap_counts[i];
+		else combined[other.heap_traits[i]] = other.heap_counts[i] + this_min;
+	}
+
+	std::vector<std::pair<int,int>> entries(combined.begin(), combined.end());
+	if((int)entries.size() > capacity) {
+		std::nth_element(entries.begin(), entries.begin() + capacity, entries.end(),
+			[](const std::pair<int,int>& a, const std::pair<int,int>& b) { return a.second > b.second; });
+		entries.resize(capacity);
+	}
+
+	heap_traits.clear();
+	heap_counts.clear();
+	slot_of_trait.clear();
+	for(auto it = entries.begin(); it != entries.end(); ++it) {
+		add(it->first, it->second);
+	}
+}
+
+
+std::vector<std::pair<int,int>> SpaceSavingSketch::top(int k) const {
+	std::vector<std::pair<int,int>> entries;
+	for(size_t i = 0; i < heap_traits.size(); i++) {
+		entries.push_back(std::make_pair(heap_traits[i], heap_counts[i]));
+	}
+	int keep = std::min(k, (int)entries.size());
+	std::partial_sort(entries.begin(), entries.begin() + keep, entries.end(),
+		[](const std::pair<int,int>& a, const std::pair<int,int>& b) { return a.second > b.second; });
+	entries.resize(keep);
+	return entries;
+}
+
+
+
+std::shared_ptr<TopTraits> calculate_top_traits(std::shared_ptr<TraitFrequencies> tf, int k) {
+	timer.start("topk::calculate_top_traits");
+	std::shared_ptr<TopTraits> top(new TopTraits(tf->numloci, k, false));
+
+	typedef std::pair<int,int> count_trait;
+	for(int locus = 0; locus < tf->numloci; locus++) {
+		int* row = tf->trait_counts + (size_t)locus * tf->max_num_traits;
+		const uint64_t* words = tf->occupancy + (size_t)locus * tf->occupancy_words;
+
+		// min-heap on count holds the best k seen so far
+		std::priority_queue<count_trait, std::vector<count_trait>, std::greater<count_trait>> heap;
+		for(int w = 0; w < tf->occupancy_words; w++) {
+			uint64_t bits = words[w];
+			while(bits) {
+				int trait = w * 64 + CTZ64(bits);
+				bits &= bits - 1;
+				if((int)heap.size() < k) {
+					heap.push(count_trait(row[trait], trait));
+				}
+				else if(row[trait] > heap.top().first) {
+					heap.pop();
+					heap.push(count_trait(row[trait], trait));
+				}
+			}
+		}
+
+		std::vector<std::pair<int,int>>& result = top->top_by_locus[locus];
+		result.resize(heap.size());
+		for(int i = heap.size() - 1; i >= 0; i--) {
+			result[i] = std::make_pair(heap.top().second, heap.top().first);
+			heap.pop();
+		}
+	}
+
+	timer.end("topk::calculate_top_traits");
+	return top;
+}
+
+
+std::vector<int> calculate_top_turnover(std::shared_ptr<TopTraits> prev, std::shared_ptr<TopTraits> curr) {
+	std::vector<int> turnover(curr->numloci, 0);
+	for(int locus = 0; locus < curr->numloci; locus++) {
+		std::unordered_set<int> previous;
+		for(auto it = prev->top_by_locus[locus].begin(); it != prev->top_by_locus[locus].end(); ++it) {
+			previous.insert(it->first);
+		}
+		for(auto it = curr->top_by_locus[locus].begin(); it != curr->top_by_locus[locus].end(); ++it) {
+			if(previous.count(it->first) == 0) ++turnover[locus];
+		}
+	}
+	return turnover;
+}
+
+
+void print_top_traits(std::shared_ptr<TopTraits> top) {
+	// skip if logging level isn't high enough
+	if(clog->level() == spd::level::trace || clog->level() == spd::level::debug) {
+
+		for(int locus = 0; locus < top->numloci; locus++) {
+			std::stringstream s;
+			s << "top " << top->k << (top->approximate ? " (approx)" : "") << " @ locus: " << locus << ":";
+			for(auto it = top->top_by_locus[locus].begin(); it != top->top_by_locus[locus].end(); ++it) {
+				s << " " << it->first << ":" << it->second;
+			}
+			SPDLOG_DEBUG(clog,"{}",s.str());
+		}
+	}
+}
+
+
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <memory>
+#include "defines.h"
+#include "statistics.h"
+
+
+namespace CTModels {
+
+/** \class TopTraits
+*
+* TopTraits holds the k most frequent traits at each locus, as (trait, count) pairs ordered from most
+* to least frequent.  When produced by the Space-Saving sketch (approximate is true), counts are 
+* upper bounds which overestimate the true count by at most the total count divided by the sketch capacity.
+*/
+
+class TopTraits {
+public:
+	int numloci;
+	int k;
+	bool approximate;
+	std::vector<std::vector<std::pair<int,int>>> top_by_locus;
+
+	TopTraits(int numloci, int k, bool approximate) : numloci(numloci), k(k), approximate(approximate), top_by_locus(numloci) {}
+};
+
+
+/** \class SpaceSavingSketch
+*
+* Space-Saving heavy hitter sketch (Metwally, Agrawal and El Abbadi 2005) for the traits at a single locus.  
+* Keeps at most capacity monitored traits in a min-heap on count, with a hash index from trait to heap slot.
+* A monitored trait is incremented in place; an unmonitored one replaces the current minimum and inherits
+* its count, so every estimate is an upper bound.  Sketches built over disjoint parts of the population can 
+* be combined with merge().
+*/
+
+class SpaceSavingSketch {
+private:
+	int capacity;
+	std::vector<int> heap_traits;
+	std::vector<int> heap_counts;
+	std::unordered_map<int,int> slot_of_trait;
+
+	void sift_down(int slot);
+	void swap_slots(int a, int b);
+
+public:
+	SpaceSavingSketch(int capacity) : capacity(capacity) {
+		slot_of_trait.reserve(capacity * 2);
+	}
+
+	void add(int trait, int count = 1);
+
+	/**
+	* Folds another sketch into this one.  A trait monitored by only one sketch is credited with the other's 
+	* minimum count when the other is full, which preserves the upper bound guarantee.  
+	*/
+	void merge(const SpaceSavingSketch& other);
+
+	int min_count() const { return ((int)heap_counts.size() < capacity || heap_counts.empty()) ? 0 : heap_counts[0]; }
+
+	/**
+	* Returns the k traits with the largest estimated counts, most frequent first.
+	*/
+	std::vector<std::pair<int,int>> top(int k) const;
+};
+
+
+/* Defined in topk.cpp */
+
+/**
+* Exact top-k traits at each locus from a TraitFrequencies sample.  Only occupied traits are visited, by 
+* walking the occupancy bitmap, and selection uses a size-k min-heap, so the count rows are never copied
+* or sorted.
+*/
+std::shared_ptr<TopTraits> calculate_top_traits(std::shared_ptr<TraitFrequencies> tf, int k);
+
+/**
+* Bentley's turnover for top lists:  the number of traits in the current top-k list at each locus which were 
+* not in the previous one.  
+*/
+std::vector<int> calculate_top_turnover(std::shared_ptr<TopTraits> prev, std::shared_ptr<TopTraits> curr);
+
+void print_top_traits(std::shared_ptr<TopTraits> top);
+
+};
@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include "catch.hpp"
+#include "population.h"
+#include "checkpoint.h"
+
+using namespace CTModels;
+
+static const std::string CHECKPOINT_PATH = "unittest-checkpoint.ckpt";
+
+
+static std::vector<int> counts_of(Population& pop) {
+	auto tf = pop.tabulate_trait_counts();
+	return std::vector<int>(tf->trait_counts, tf->trait_counts + (size_t)tf->numloci * tf->max_num_traits);
+}
+
+static std::vector<int> sample_of(Population& pop) {
+	auto tf = pop.tabulate_sample_trait_counts(200, false);
+	std::vector<int> v(tf->trait_counts, tf->trait_counts + (size_t)tf->numloci * tf->max_num_traits);
+	v.insert(v.end(), tf->trait_ids.begin(), tf->trait_ids.end());
+	return v;
+}
+
+static void step(Population& pop, ruletype rule) {
+	if(rule == WFIA) pop.step_wfia();
+	else pop.step_basicwf();
+}
+
+
+TEST_CASE("a population resumed from a checkpoint repeats the uninterrupted run", "[checkpoint]") {
+	// a mean of 100 innovations per generation puts the Poisson distribution on its cached normal approximation
+	ruletype rule = WFIA;
+	int stop = 0;
+	SECTION("wfia, checkpoint at generation 7") { stop = 7; }
+	SECTION("wfia, checkpoint at generation 12") { stop = 12; }
+	SECTION("basicwf, checkpoint at generation 9") { stop = 9; rule = BASICWF; }
+
+	Population pop(2000, 3, 6, 0.05);
+	pop.set_seed(41);
+	pop.initialize();
+	for(int g = 0; g < stop; g++) step(pop, rule);
+	{
+		CheckpointWriter writer(CHECKPOINT_PATH);
+		pop.write_checkpoint(writer, rule);
+		REQUIRE(writer.wait());
+	}
+	for(int g = stop; g < 25; g++) step(pop, rule);
+	std::vector<int> expected_sample = sample_of(pop);
+	std::vector<int> expected = counts_of(pop);
+
+	ruletype restored_rule;
+	std::unique_ptr<Population> resumed(Population::from_checkpoint(CHECKPOINT_PATH, restored_rule));
+	REQUIRE(resumed);
+	REQUIRE(restored_rule == rule);
+	REQUIRE(resumed->get_generation() == stop);
+	for(int g = stop; g < 25; g++) step(*resumed, rule);
+	REQUIRE(sample_of(*resumed) == expected_sample);
+	REQUIRE(counts_of(*resumed) == expected);
+
+	std::remove(CHECKPOINT_PATH.c_str());
+}
+
+
+TEST_CASE("taking samples does not change a seeded trajectory", "[checkpoint]") {
+	Population plain(2000, 3, 6, 0.01);
+	plain.set_seed(7);
+	plain.initialize();
+	Population sampled(2000, 3, 6, 0.01);
+	sampled.set_seed(7);
+	sampled.initialize();
+
+	for(int g = 0; g < 20; g++) {
+		plain.step_wfia();
+		sampled.step_wfia();
+		sampled.tabulate_sample_trait_counts(50, g % 2 == 0);
+		sampled.compact_traits(100, false);
+	}
+	REQUIRE(counts_of(plain) == counts_of(sampled));
+}
+
+
+#if defined(_OPENMP)
+TEST_CASE("a seeded run does not depend on the number of threads", "[checkpoint]") {
+	int saved = omp_get_max_threads();
+	std::vector<std::vector<int>> results;
+	for(int threads : {1, 4}) {
+		omp_set_num_threads(threads);
+		Population pop(3000, 2, 5, 0.02);
+		pop.set_seed(13);
+		pop.initialize();
+		for(int g = 0; g < 15; g++) pop.step_wfia();
+		results.push_back(counts_of(pop));
+	}
+	omp_set_num_threads(saved);
+	REQUIRE(results[0] == results[1]);
+}
+#endif
+
+
+TEST_CASE("checkpoints that are damaged or of another format are rejected", "[checkpoint]") {
+	Population pop(500, 2, 4, 0.01);
+	pop.set_seed(3);
+	pop.initialize();
+	pop.step_wfia();
+	{
+		CheckpointWriter writer(CHECKPOINT_PATH);
+		pop.write_checkpoint(writer, WFIA);
+		REQUIRE(writer.wait());
+	}
+	std::string contents;
+	{
+		std::ifstream in(CHECKPOINT_PATH.c_str(), std::ios::binary);
+		contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	REQUIRE(contents.size() > sizeof(CheckpointHeader));
+
+	SECTION("truncated") {
+		contents.resize(contents.size() / 2);
+	}
+	SECTION("shorter than a header") {
+		contents.resize(sizeof(CheckpointHeader) / 2);
+	}
+	SECTION("wrong magic number") {
+		contents[0] ^= 0x5a;
+	}
+	SECTION("other version") {
+		CheckpointHeader h;
+		memcpy(&h, contents.data(), sizeof(h));
+		h.version = CHECKPOINT_VERSION + 1;
+		memcpy(&contents[0], &h, sizeof(h));
+	}
+	SECTION("unknown copying rule") {
+		CheckpointHeader h;
+		memcpy(&h, contents.data(), sizeof(h));
+		h.rule = 17;
+		memcpy(&contents[0], &h, sizeof(h));
+	}
+	SECTION("preamble past the trait matrix") {
+		CheckpointHeader h;
+		memcpy(&h, contents.data(), sizeof(h));
+		h.rng_state_bytes = h.traits_offset;
+		memcpy(&contents[0], &h, sizeof(h));
+	}
+	{
+		std::ofstream out(CHECKPOINT_PATH.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(contents.data(), contents.size());
+	}
+
+	ruletype rule;
+	std::unique_ptr<Population> restored(Population::from_checkpoint(CHECKPOINT_PATH, rule));
+	REQUIRE(!restored);
+	std::remove(CHECKPOINT_PATH.c_str());
+}
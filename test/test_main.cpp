@@ -0,0 +1,3 @@
+// Supplies main() for the unit tests; the tests themselves live in the other test_*.cpp files.
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
@@ -0,0 +1,194 @@
+#include <set>
+#include <utility>
+#include <vector>
+#include "catch.hpp"
+#include "network.h"
+
+using namespace CTModels;
+
+typedef std::set<std::pair<int, int>> EdgeSet;
+
+
+// every arc of the dynamic graph, failing if a list holds a repeat or a self loop
+static EdgeSet arcs_of(const DynamicNetwork& g) {
+	EdgeSet arcs;
+	for(int v = 0; v < g.num_nodes; v++) {
+		REQUIRE(g.degrees[v] <= g.capacities[v]);
+		for(int i = 0; i < g.degrees[v]; i++) {
+			int w = g.slots[g.starts[v] + i];
+			REQUIRE(w != v);
+			REQUIRE(arcs.insert(std::make_pair(v, w)).second);
+		}
+	}
+	return arcs;
+}
+
+static void add_edge(EdgeSet& reference, int u, int v) {
+	if(u == v) return;
+	reference.insert(std::make_pair(u, v));
+	reference.insert(std::make_pair(v, u));
+}
+
+static void remove_edge(EdgeSet& reference, int u, int v) {
+	reference.erase(std::make_pair(u, v));
+	reference.erase(std::make_pair(v, u));
+}
+
+static std::shared_ptr<SocialNetwork> ring(int n) {
+	std::vector<int> src, dst;
+	for(int v = 0; v < n; v++) {
+		src.push_back(v);
+		dst.push_back((v + 1) % n);
+	}
+	return SocialNetwork::from_edges(n, src, dst);
+}
+
+static EdgeSet ring_edges(int n) {
+	EdgeSet reference;
+	for(int v = 0; v < n; v++) add_edge(reference, v, (v + 1) % n);
+	return reference;
+}
+
+
+TEST_CASE("dynamic network copies the static graph", "[network]") {
+	auto g = ring(50);
+	DynamicNetwork dn(*g, 0.5);
+	REQUIRE(arcs_of(dn) == ring_edges(50));
+	REQUIRE(dn.num_arcs == 100);
+}
+
+
+TEST_CASE("dynamic network relocates nodes that outgrow their slots", "[network]") {
+	auto g = ring(40);
+	DynamicNetwork dn(*g, 0.0);
+	EdgeSet reference = ring_edges(40);
+
+	int old_capacity = dn.capacities[0];
+	for(int v = 2; v < 30; v++) {
+		dn.queue_insert(0, v);
+		add_edge(reference, 0, v);
+	}
+	dn.apply_updates();
+
+	REQUIRE(dn.capacities[0] > old_capacity);
+	REQUIRE(dn.degrees[0] == 30);
+	REQUIRE(arcs_of(dn) == reference);
+	REQUIRE(dn.num_arcs == (int64_t)reference.size());
+}
+
+
+TEST_CASE("dynamic network compaction keeps every edge", "[network]") {
+	auto g = ring(200);
+	DynamicNetwork dn(*g, 0.0);
+	EdgeSet reference = ring_edges(200);
+
+	// grow every node in several rounds, so relocations leave enough holes to trigger compaction
+	for(int round = 1; round <= 6; round++) {
+		for(int v = 0; v < 200; v++) {
+			int w = (v + 2 + round * 7) % 200;
+			dn.queue_insert(v, w);
+			add_edge(reference, v, w);
+		}
+		dn.apply_updates();
+		REQUIRE(arcs_of(dn) == reference);
+	}
+
+	int64_t needed = 0;
+	for(int v = 0; v < 200; v++) needed += dn.capacities[v];
+	REQUIRE((int64_t)dn.slots.size() <= 4 * needed);
+
+	dn.compact();
+	REQUIRE(arcs_of(dn) == reference);
+	for(int v = 0; v + 1 < 200; v++) {
+		REQUIRE(dn.starts[v + 1] == dn.starts[v] + dn.capacities[v]);
+	}
+}
+
+
+TEST_CASE("dynamic network applies deletions before insertions within a batch", "[network]") {
+	auto g = ring(20);
+	DynamicNetwork dn(*g, 0.5);
+	EdgeSet reference = ring_edges(20);
+
+	SECTION("an edge deleted and reinserted in one batch survives once") {
+		dn.queue_insert(3, 4);
+		dn.queue_delete(3, 4);
+		dn.apply_updates();
+		REQUIRE(arcs_of(dn) == reference);
+		REQUIRE(dn.num_arcs == 40);
+	}
+
+	SECTION("a new edge deleted and inserted in one batch is added") {
+		dn.queue_delete(5, 12);
+		dn.queue_insert(5, 12);
+		dn.queue_insert(12, 5);
+		dn.apply_updates();
+		add_edge(reference, 5, 12);
+		REQUIRE(arcs_of(dn) == reference);
+		REQUIRE(dn.num_arcs == 42);
+	}
+
+	SECTION("self loops and deletions of missing edges are ignored") {
+		dn.queue_insert(7, 7);
+		dn.queue_delete(7, 15);
+		dn.apply_updates();
+		REQUIRE(arcs_of(dn) == reference);
+		REQUIRE(dn.num_arcs == 40);
+	}
+}
+
+
+TEST_CASE("dynamic network matches a reference edge set over random batches", "[network]") {
+	int n = 300;
+	auto g = SocialNetwork::erdos_renyi(n, 4.0, 17);
+	DynamicNetwork dn(*g, 0.25);
+	EdgeSet reference = arcs_of(dn);
+
+	for(int batch = 0; batch < 50; batch++) {
+		for(int k = 0; k < 40; k++) {
+			uint64_t r = hash_random(batch, k);
+			int u = random_below(r, n);
+			int v = random_below(r << 32, n);
+			if(k % 3 == 0) {
+				dn.queue_delete(u, v);
+				remove_edge(reference, u, v);
+			}
+		}
+		for(int k = 0; k < 40; k++) {
+			uint64_t r = hash_random(batch, k);
+			int u = random_below(r, n);
+			int v = random_below(r << 32, n);
+			if(k % 3 != 0) {
+				dn.queue_insert(u, v);
+				add_edge(reference, u, v);
+			}
+		}
+		dn.apply_updates();
+		REQUIRE(arcs_of(dn) == reference);
+		REQUIRE(dn.num_arcs == (int64_t)reference.size());
+	}
+}
+
+
+#if defined(_OPENMP)
+TEST_CASE("dynamic network accepts updates from a team larger than it was built for", "[network]") {
+	int saved = omp_get_max_threads();
+	omp_set_num_threads(1);
+	auto g = ring(64);
+	DynamicNetwork dn(*g, 0.5);
+	omp_set_num_threads(saved);
+
+	EdgeSet reference = ring_edges(64);
+	#pragma omp parallel for num_threads(8) schedule(static, 1)
+	for(int v = 0; v < 64; v++) {
+		dn.queue_insert(v, (v + 32) % 64);
+	}
+	for(int v = 0; v < 64; v++) add_edge(reference, v, (v + 32) % 64);
+	dn.apply_updates();
+	REQUIRE(arcs_of(dn) == reference);
+
+	dn.queue_random_rewiring(0.5, 99);
+	dn.apply_updates();
+	REQUIRE((int64_t)arcs_of(dn).size() == dn.num_arcs);
+}
+#endif
@@ -0,0 +1,44 @@
+#include <vector>
+#include "catch.hpp"
+#include "sweep.h"
+
+using namespace CTModels;
+
+
+static SweepSpec grid_spec() {
+	SweepSpec spec;
+	spec.popsize = {100, 200};
+	spec.numloci = {2};
+	spec.inittraits = {3};
+	spec.innovrate = {0.01};
+	spec.simlength = {10};
+	spec.rules = {WFIA};
+	return spec;
+}
+
+
+TEST_CASE("sweep expansion rejects configurations that cannot be simulated", "[sweep]") {
+	SweepSpec spec = grid_spec();
+	REQUIRE(spec.expand().size() == 2);
+
+	SECTION("a grid value that truncates to 0") {
+		spec.inittraits = {3, 0.5};
+		REQUIRE(spec.expand().empty());
+	}
+	SECTION("a Latin hypercube point that rounds to 0") {
+		spec.latin_hypercube = true;
+		spec.samples = 16;
+		spec.numloci = {0.1, 3};
+		REQUIRE(spec.expand().empty());
+	}
+	SECTION("a Latin hypercube within valid bounds") {
+		spec.latin_hypercube = true;
+		spec.samples = 16;
+		spec.numloci = {1, 3};
+		std::vector<RunParameters> configs = spec.expand();
+		REQUIRE(configs.size() == 16);
+		for(size_t c = 0; c < configs.size(); c++) {
+			REQUIRE(valid_run_parameters(configs[c]));
+		}
+	}
+}